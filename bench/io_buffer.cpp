@@ -0,0 +1,126 @@
+// Compares IOBuffer with the former readAll/writeAll of system_read_write.
+// Usage: io_buffer_benchmark [total MiB per size]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "ioBuffer.h"
+
+// The former readAll: 128 KiB buffer copied through an ostringstream. The buffer is
+// reset after it is flushed, the original did not and corrupted longer output.
+static std::string oldReadAll(int file) {
+    std::ostringstream result{};
+
+    static int size = 1024 * 128;
+    char* buffer = new char[size + 1];
+    int number_read = 0;
+
+    while (true) {
+        errno = 0;
+        int current_number_read = read(file, buffer + number_read, (size - number_read));
+        if (current_number_read < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Cannot read from given file!");
+        }
+        if (current_number_read == 0) {
+            buffer[number_read] = '\0';
+            result << buffer;
+            break;
+        }
+        number_read += current_number_read;
+        if (number_read == size) {
+            buffer[size] = '\0';
+            result << buffer;
+            number_read = 0;
+        }
+    }
+
+    delete[] buffer;
+    return result.str();
+}
+
+// The former writeAll, the message is taken by value
+static void oldWriteAll(int file, std::string message) {
+    size_t number_written = 0;
+
+    while (number_written < message.length()) {
+        errno = 0;
+        ssize_t current_number_written = write(file, message.c_str() + number_written, message.length() - number_written);
+        if (current_number_written < 0) {
+            if (errno != EINTR) throw std::runtime_error("Cannot write to given file!");
+        } else {
+            number_written += current_number_written;
+        }
+    }
+}
+
+// Runs the function the given number of times, returns MiB/s
+static double measure(size_t size, size_t runs, const std::function<void()>& function) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; ++i) function();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (double) size * runs / (1024 * 1024) / seconds;
+}
+
+int main(int argc, char** argv) {
+    size_t total = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 512) * 1024 * 1024;
+
+    // the data is read from and written to the page cache of unlinked files
+    char path[] = "/tmp/io_buffer_benchmarkXXXXXX";
+    char outputPath[] = "/tmp/io_buffer_benchmarkXXXXXX";
+    int file = mkstemp(path);
+    int output = mkstemp(outputPath);
+    if (file < 0 || output < 0) {
+        std::perror("mkstemp");
+        return 1;
+    }
+    unlink(path);
+    unlink(outputPath);
+
+    std::printf("%-10s %14s %14s %14s %14s\n", "size", "old read", "IOBuffer read", "old write", "IOBuffer write");
+    for (size_t size: std::vector<size_t>{4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024}) {
+        std::string content(size, 'x');
+        if (ftruncate(file, 0) < 0 || pwrite(file, content.c_str(), size, 0) != (ssize_t) size) {
+            std::perror("write");
+            return 1;
+        }
+        size_t runs = std::max(total / size, (size_t) 1);
+
+        double oldRead = measure(size, runs, [&]() {
+            lseek(file, 0, SEEK_SET);
+            if (oldReadAll(file).size() != size) throw std::runtime_error("Short read");
+        });
+        double newRead = measure(size, runs, [&]() {
+            lseek(file, 0, SEEK_SET);
+            IOBuffer buffer;
+            if (buffer.readAll(file) != size) throw std::runtime_error("Short read");
+        });
+
+        IOBuffer buffer;
+        buffer.append(content);
+        double oldWrite = measure(size, runs, [&]() {
+            lseek(output, 0, SEEK_SET);
+            oldWriteAll(output, content);
+        });
+        double newWrite = measure(size, runs, [&]() {
+            lseek(output, 0, SEEK_SET);
+            buffer.writeAll(output);
+        });
+
+        std::printf("%-10zu %9.0f MiB/s %9.0f MiB/s %9.0f MiB/s %9.0f MiB/s\n", size, oldRead, newRead, oldWrite, newWrite);
+    }
+
+    close(output);
+    close(file);
+    return 0;
+}
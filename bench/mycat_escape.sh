@@ -0,0 +1,33 @@
+#!/bin/sh
+# Measures the throughput of mycat -A and -U with every escaping kernel on text, UTF-8 text and binary input.
+# Build with -DCMAKE_BUILD_TYPE=Release, the vector kernels are slow without optimizations.
+# Usage: bench/mycat_escape.sh <path to mycat> [size in MiB]
+
+MYCAT=${1:-./mycat}
+SIZE=${2:-256}
+TEXT=$(mktemp)
+BINARY=$(mktemp)
+UTF8=$(mktemp)
+trap 'rm -f "$TEXT" "$BINARY" "$UTF8"' EXIT
+
+# mostly text: printable lines with a rare control character
+yes 'The quick brown fox jumps over the lazy dog 0123456789 ~!@#$%^&*()' |
+    awk 'NR % 64 == 0 { printf "\001" } { print }' | head -c "${SIZE}M" > "$TEXT"
+head -c "${SIZE}M" /dev/urandom > "$BINARY"
+yes 'Съешь же ещё этих мягких французских булок 日本語のテキスト 😀 plain ascii' | head -c "${SIZE}M" > "$UTF8"
+
+# kernel, mode, input
+measure() {
+    start=$(date +%s%N)
+    MYCAT_ESCAPE=$1 "$MYCAT" "$2" "$3" > /dev/null || return
+    end=$(date +%s%N)
+    echo "$(( SIZE * 1000000000 / (end - start) )) MiB/s"
+}
+
+echo "size: $SIZE MiB"
+for kernel in scalar sse2 avx2; do
+    echo "$kernel -A text:    $(measure $kernel -A "$TEXT")"
+    echo "$kernel -A binary:  $(measure $kernel -A "$BINARY")"
+    echo "$kernel -U utf-8:   $(measure $kernel -U "$UTF8")"
+    echo "$kernel -U binary:  $(measure $kernel -U "$BINARY")"
+done
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Compares the throughput of mycat with every buffer size and mode against the system cat.
+# Usage: bench/mycat_throughput.sh <path to mycat> [size in MiB]
+
+MYCAT=${1:-./mycat}
+SIZE=${2:-512}
+INPUT=$(mktemp)
+OUTPUT=$(mktemp)
+trap 'rm -f "$INPUT" "$OUTPUT"' EXIT
+
+yes 'The quick brown fox jumps over the lazy dog 0123456789 ~!@#$%^&*()' | head -c "${SIZE}M" > "$INPUT"
+# read once, so that every run starts from the page cache
+cat "$INPUT" > /dev/null
+
+# GB/s of the command writing to the given target: file, pipe or null
+measure() {
+    target=$1
+    shift
+    start=$(date +%s%N)
+    case $target in
+        file) "$@" "$INPUT" > "$OUTPUT" ;;
+        pipe) "$@" "$INPUT" | cat > /dev/null ;;
+        null) "$@" "$INPUT" > /dev/null ;;
+    esac
+    end=$(date +%s%N)
+    awk -v size="$SIZE" -v ns="$((end - start))" 'BEGIN { printf "%.2f GB/s", size * 1048576 / ns }'
+}
+
+echo "size: $SIZE MiB"
+printf '%-14s %-8s %-12s %-12s %-12s\n' command mode file pipe null
+for mode in plain -A -n; do
+    options=
+    [ "$mode" = plain ] || options=$mode
+    for buffer in auto 4K 64K 128K 1M 4M; do
+        size_option=
+        [ "$buffer" = auto ] || size_option="-B $buffer"
+        printf '%-14s %-8s %-12s %-12s %-12s\n' "mycat $buffer" "$mode" \
+            "$(measure file "$MYCAT" $size_option $options)" \
+            "$(measure pipe "$MYCAT" $size_option $options)" \
+            "$(measure null "$MYCAT" $size_option $options)"
+    done
+    # the system cat has no hex escaping, -v is the closest
+    [ "$mode" = -A ] && options=-v
+    printf '%-14s %-8s %-12s %-12s %-12s\n' "cat" "$mode" \
+        "$(measure file cat $options)" "$(measure pipe cat $options)" "$(measure null cat $options)"
+done
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Compares cold-start time of myshell with /bin/sh on an empty script.
+# Usage: bench/startup.sh <path to myshell> [runs]
+
+MYSHELL=${1:-./myshell}
+RUNS=${2:-1000}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+measure() {
+    start=$(date +%s%N)
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        "$@" "$SCRIPT" > /dev/null
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    echo "$(( (end - start) / RUNS / 1000 ))"
+}
+
+echo "runs: $RUNS"
+echo "/bin/sh:  $(measure /bin/sh) us per start"
+echo "myshell:  $(measure "$MYSHELL") us per start"
+"$MYSHELL" --startup-profile "$SCRIPT"
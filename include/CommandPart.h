@@ -10,6 +10,8 @@ struct CommandPart {
     std::string string;
     std::vector<bool> escaped;
     char quotes = 0;
+    // an unquoted wild card left for mbatch to expand
+    bool deferredWildCard = false;
 
     CommandPart() = default;
     CommandPart(char* string, bool escape=true, char escapeChar='\\'):
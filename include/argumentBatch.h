@@ -0,0 +1,35 @@
+#ifndef MYSHELL_ARGUMENTBATCH_H
+#define MYSHELL_ARGUMENTBATCH_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Collects arguments into command lines that execve accepts, like xargs does
+class ArgumentBatch {
+    std::vector<std::string> fixed;
+    std::vector<std::string> arguments;
+    size_t fixedSize = 0;
+    size_t size = 0;
+    size_t limit;
+    size_t maxArguments;
+
+public:
+    static const size_t NO_LIMIT;
+
+    // Bytes taken by the argument string and its argv pointer
+    static size_t argumentSize(const std::string& argument);
+    // ARG_MAX without the environment that is passed together with the arguments
+    static size_t systemLimit(const std::unordered_map<std::string, std::string>& environment);
+
+    ArgumentBatch(std::vector<std::string> fixed, size_t limit, size_t maxArguments=NO_LIMIT);
+
+    // False if the argument has to go to the next batch, throws if it does not fit even an empty one
+    bool fits(const std::string& argument) const;
+    void add(const std::string& argument);
+    bool empty() const { return arguments.empty(); }
+    // The fixed part followed by the collected arguments, the batch is emptied
+    std::vector<std::string> take();
+};
+
+#endif //MYSHELL_ARGUMENTBATCH_H
@@ -0,0 +1,49 @@
+#ifndef MYSHELL_ARITHMETIC_H
+#define MYSHELL_ARITHMETIC_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Compiled arithmetic expression of $(( ... )) with 64-bit integers.
+// Compiled once and evaluated with the current variable values, so it can be cached.
+class ArithmeticExpression {
+public:
+    using lookup_t = std::function<std::string(const std::string&)>;
+
+    // Throws std::invalid_argument on syntax errors
+    explicit ArithmeticExpression(const std::string& expression);
+    // Throws std::invalid_argument on invalid variable values and division by zero
+    int64_t evaluate(const lookup_t& lookup) const;
+
+private:
+    enum Kind { NUMBER, VARIABLE, UNARY, BINARY, TERNARY };
+    struct Node {
+        Kind kind;
+        std::string op;
+        int64_t value;
+        std::string name;
+        int left;
+        int right;
+        int third;
+    };
+
+    std::vector<Node> nodes;
+    int root;
+
+    // parser state
+    std::vector<std::string> tokens;
+    size_t position = 0;
+
+    void tokenize(const std::string& expression);
+    int add(Node node);
+    int parseTernary();
+    int parseBinary(int precedence);
+    int parseUnary();
+    int parsePrimary();
+
+    int64_t evaluate(int node, const lookup_t& lookup) const;
+};
+
+#endif //MYSHELL_ARITHMETIC_H
@@ -0,0 +1,23 @@
+#ifndef MYSHELL_BENCHMARK_H
+#define MYSHELL_BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+struct BenchmarkSample {
+    double wallMicroseconds;
+    double cpuMicroseconds;
+    long peakRssKilobytes;
+};
+
+struct BenchmarkConfig {
+    size_t runs = 10;
+    size_t warmup = 0;
+    size_t parallel = 1;
+    bool json = false;
+};
+
+// Report with wall time percentiles, cpu time, peak rss and a log-linear latency histogram
+std::string formatBenchmarkReport(std::vector<BenchmarkSample> samples, const BenchmarkConfig& config);
+
+#endif //MYSHELL_BENCHMARK_H
@@ -0,0 +1,13 @@
+#ifndef MYSHELL_FANOUT_H
+#define MYSHELL_FANOUT_H
+
+#include <string>
+#include <vector>
+
+// Duplicates everything read from the input pipe into all the output pipes with tee(2)/splice(2),
+// so that the data never gets copied into user space. Waits for the slowest consumer when
+// its pipe is full and reports consumers that stalled the producer for long.
+// Closes the outputs at the end.
+void relayFanOut(int input, const std::vector<int>& outputs, const std::vector<std::string>& names);
+
+#endif //MYSHELL_FANOUT_H
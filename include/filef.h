@@ -0,0 +1,36 @@
+#ifndef MYSHELL_FILEF_H
+#define MYSHELL_FILEF_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Formatted output without stdio. Supports %s %c %d %u %zu %x and %%, with an optional
+// width and the - flag for left alignment (e.g. %-30s, %14zu). Other conversions are printed as is.
+
+// Collects the formatted output for a file, it is written on flush or when it does not fit
+struct filef_buffer {
+    int file;
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+// The storage of the given capacity is owned by the caller
+void filef_buffer_init(struct filef_buffer* buffer, int file, char* storage, size_t capacity);
+// All the functions return 1 if a write failed
+int filef_flush(struct filef_buffer* buffer);
+int bfilef(struct filef_buffer* buffer, const char* format, ...);
+int vbfilef(struct filef_buffer* buffer, const char* format, va_list list);
+
+// The whole message is written with a single writev
+int filef(int file_number, const char* format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MYSHELL_FILEF_H
@@ -0,0 +1,86 @@
+#ifndef MYSHELL_IOBUFFER_H
+#define MYSHELL_IOBUFFER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Growable buffer made of a chain of chunks. Read data is never moved, the buffer
+// grows by adding chunks of increasing size. Reads and writes use readv/writev.
+class IOBuffer {
+public:
+    static const size_t NO_LIMIT = SIZE_MAX;
+
+    IOBuffer(): limit(NO_LIMIT) {}
+    // Data over the limit is read and dropped
+    explicit IOBuffer(size_t limit): limit(limit) {}
+    // Copies keep the content in a single chunk
+    IOBuffer(const IOBuffer& other);
+    IOBuffer& operator=(const IOBuffer& other);
+    IOBuffer(IOBuffer&& other) = default;
+    IOBuffer& operator=(IOBuffer&& other) = default;
+
+    // Replaces or extends the content, for output assembled piece by piece
+    IOBuffer& operator=(const std::string& data) {
+        clear();
+        append(data);
+        return *this;
+    }
+    IOBuffer& operator+=(const std::string& data) {
+        append(data);
+        return *this;
+    }
+
+    // Reads until the end of file, returns the number of stored bytes
+    size_t readAll(int file);
+    // Performs a single read, returns the number of read bytes (0 on end of file)
+    size_t readSome(int file);
+    void append(const char* data, size_t size);
+    void append(const std::string& data) { append(data.c_str(), data.length()); }
+
+    // Writes the whole content, the content is kept
+    void writeAll(int file) const;
+
+    size_t size() const { return stored; }
+    bool empty() const { return stored == 0; }
+    // Whether some data was dropped because of the limit
+    bool truncated() const { return wasTruncated; }
+
+    // The content as a list of memory regions - to be consumed without copying
+    std::vector<iovec> data() const;
+    // Drops the given number of bytes from the front
+    void consume(size_t size);
+    std::string str() const;
+    // Copies only the given number of bytes from the front
+    std::string str(size_t size) const;
+    // Position of the first occurrence of the character among the first `limit` bytes, or npos
+    size_t find(char c, size_t limit = NO_LIMIT) const;
+    void clear();
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t capacity;
+        size_t start;
+        size_t end;
+    };
+
+    static const size_t MIN_CHUNK = 4 * 1024;
+    static const size_t MAX_CHUNK = 1024 * 1024;
+
+    std::vector<Chunk> chunks;
+    // allocated chunk used as the second region of readv
+    Chunk spare{nullptr, 0, 0, 0};
+    size_t limit;
+    size_t stored = 0;
+    bool wasTruncated = false;
+
+    size_t nextChunkSize() const;
+    // Stores the bytes that were read into the tail free space and the spare chunk
+    void commit(size_t read, bool tailUsed);
+};
+
+#endif //MYSHELL_IOBUFFER_H
@@ -0,0 +1,41 @@
+#ifndef MYSHELL_METRICS_H
+#define MYSHELL_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Histogram of durations with fixed buckets
+struct MetricsHistogram {
+    static const size_t BUCKETS = 12;
+    static const double BOUNDS[BUCKETS];
+
+    std::atomic<uint64_t> counts[BUCKETS + 1];
+    std::atomic<uint64_t> sumNanoseconds;
+
+    void observe(double seconds);
+};
+
+// Shell-wide counters. Lives in shared memory, so that forked children (e.g. a failed exec)
+// update the same counters without locks.
+struct Metrics {
+    std::atomic<uint64_t> commands;
+    std::atomic<uint64_t> forks;
+    std::atomic<uint64_t> execFailures;
+    std::atomic<uint64_t> pathLookups;
+    std::atomic<uint64_t> wildcardExpansions;
+    std::atomic<uint64_t> wildcardEntriesScanned;
+    std::atomic<uint64_t> substitutionBytes;
+    MetricsHistogram expansionSeconds;
+    MetricsHistogram waitSeconds;
+
+    // Falls back to private memory if shared memory cannot be mapped
+    static Metrics* create();
+
+    // Prometheus text exposition format
+    std::string format() const;
+    // Writes to a temporary file and renames it, so that readers never see a partial file
+    bool writeTo(const std::string& path) const;
+};
+
+#endif //MYSHELL_METRICS_H
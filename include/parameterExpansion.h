@@ -0,0 +1,22 @@
+#ifndef MYSHELL_PARAMETEREXPANSION_H
+#define MYSHELL_PARAMETEREXPANSION_H
+
+#include <functional>
+#include <string>
+#include "CommandPart.h"
+
+struct ParameterContext {
+    // value of the variable, nullptr if it is not set
+    std::function<const std::string*(const std::string&)> lookup;
+    std::function<void(const std::string&, const std::string&)> assign;
+    // expands variables in default values and replacements
+    std::function<std::string(CommandPart&)> expandWord;
+    std::function<int64_t(const std::string&)> evaluate;
+};
+
+// Evaluates the content of ${...}:
+// name, #name, name:-word, name-word, name:+word, name:=word, name:offset[:length],
+// name#pattern, name##pattern, name%pattern, name%%pattern, name/pattern/replacement, name//pattern/replacement
+std::string expandParameter(CommandPart expression, const ParameterContext& context);
+
+#endif //MYSHELL_PARAMETEREXPANSION_H
@@ -0,0 +1,30 @@
+#ifndef MYSHELL_RECORDREADER_H
+#define MYSHELL_RECORDREADER_H
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+#include "ioBuffer.h"
+
+// Reads delimited records from descriptors in blocks instead of single bytes.
+// Seekable descriptors are moved back to the end of the record after each read, so that
+// the remaining input stays available for child processes. For other descriptors
+// the read-ahead data is kept until the next read from the same file.
+class RecordReader {
+    struct Buffer {
+        dev_t device;
+        ino_t inode;
+        IOBuffer data;
+    };
+    std::map<int, Buffer> buffers;
+
+public:
+    // Reads until the delimiter (which is dropped) or until `count` bytes are read.
+    // Returns false if the end of file was reached before anything was read.
+    bool read(int file, char delimiter, size_t count, std::string& record);
+    // Drops the read-ahead data, e.g. when the descriptor gets closed
+    void forget(int file);
+};
+
+#endif //MYSHELL_RECORDREADER_H
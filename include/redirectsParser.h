@@ -6,6 +6,8 @@
 #include "CommandPart.h"
 
 bool isRedirect(CommandPart command);
+// Redirect to a descriptor without the descriptor number, e.g. "2>&"
+bool isDescriptorRedirect(CommandPart command);
 
 std::tuple<int, int, int> parseRedirect(CommandPart command, int defaultOut = 1, int defaultIn = 0);
 
@@ -0,0 +1,31 @@
+#ifndef MYSHELL_SCHEDULING_H
+#define MYSHELL_SCHEDULING_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include "CommandPart.h"
+
+// Scheduling options of a single command (mrun prefix).
+// Applied in the child between fork and execve.
+struct Scheduling {
+    bool setAffinity = false;
+    cpu_set_t cpus;
+    bool setNice = false;
+    int nice = 0;
+    int ioClass = -1;
+    int ioLevel = 4;
+    std::vector<std::pair<int, rlim_t>> limits;
+
+    bool empty() const;
+
+    // Parses the options starting at parts[start], returns the index of the first non-option part
+    size_t parse(std::vector<CommandPart>& parts, size_t start);
+    // Applies the options to the current process, throws on failure
+    void apply() const;
+};
+
+#endif //MYSHELL_SCHEDULING_H
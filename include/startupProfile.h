@@ -0,0 +1,55 @@
+#ifndef MYSHELL_STARTUPPROFILE_H
+#define MYSHELL_STARTUPPROFILE_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+
+// Collects durations of the shell startup phases (--startup-profile)
+class StartupProfile {
+    using clock = std::chrono::steady_clock;
+
+    bool enabled = false;
+    bool reported = false;
+    clock::time_point start = clock::now();
+    std::vector<std::pair<std::string, double>> phases;
+    // time of the phases measured inside the running one
+    double nested = 0;
+
+    void finish(const std::string& name, clock::time_point phaseStart, double outerNested) {
+        double duration = std::chrono::duration<double, std::micro>(clock::now() - phaseStart).count();
+        add(name, duration - nested);
+        nested = outerNested + duration;
+    }
+
+public:
+    void enable() { enabled = true; }
+    bool isEnabled() const { return enabled; }
+
+    // Runs the function and records its duration under the given name,
+    // without the phases measured inside it, which are recorded on their own
+    template <typename Function>
+    void measure(const std::string& name, Function function) {
+        if (!enabled || reported) {
+            function();
+            return;
+        }
+        double outerNested = nested;
+        nested = 0;
+        clock::time_point phaseStart = clock::now();
+        try {
+            function();
+        } catch (...) {
+            finish(name, phaseStart, outerNested);
+            throw;
+        }
+        finish(name, phaseStart, outerNested);
+    }
+
+    void add(const std::string& name, double microseconds);
+    // Prints the report to stderr once, later phases are not recorded
+    void report();
+};
+
+#endif //MYSHELL_STARTUPPROFILE_H
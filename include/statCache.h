@@ -0,0 +1,29 @@
+#ifndef MYSHELL_STATCACHE_H
+#define MYSHELL_STATCACHE_H
+
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Small cache of stat results. Should be cleared whenever files may have changed,
+// e.g. before each line and after starting a process.
+class StatCache {
+    struct Entry {
+        bool exists;
+        struct stat fileStat;
+    };
+    std::unordered_map<std::string, Entry> entries;
+    static const size_t MAX_ENTRIES = 64;
+    // relative paths are resolved against this directory descriptor
+    int directory = AT_FDCWD;
+
+public:
+    void setDirectory(int newDirectory);
+    int getDirectory() const { return directory; }
+    // nullptr if the file doesn't exist
+    const struct stat* get(const std::string& path);
+    void clear() { entries.clear(); }
+};
+
+#endif //MYSHELL_STATCACHE_H
@@ -6,7 +6,7 @@
 #include <string>
 
 std::string readAll(int file);
-void writeAll(int filed, std::string message);
+void writeAll(int filed, const std::string& message);
 
 void read_to_buffer(int file, char* buffer, size_t buffer_size);
 void write_from_buffer(int file, char* buffer, size_t buffer_size);
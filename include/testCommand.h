@@ -0,0 +1,14 @@
+#ifndef MYSHELL_TESTCOMMAND_H
+#define MYSHELL_TESTCOMMAND_H
+
+#include <string>
+#include <vector>
+#include "statCache.h"
+
+// Evaluates the arguments of mtest (without the command name).
+// Supports ! -a -o, file tests -e -f -d -x -r -w -s -L, FILE -nt/-ot FILE,
+// strings -z -n = == != and integers -eq -ne -lt -le -gt -ge.
+// Throws std::invalid_argument on syntax errors.
+bool evaluateTest(const std::vector<std::string>& arguments, StatCache& statCache);
+
+#endif //MYSHELL_TESTCOMMAND_H
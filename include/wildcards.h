@@ -3,10 +3,17 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 #include "CommandPart.h"
 
 bool testWildCard(std::string str, CommandPart wildCard);
+// Matches only the str[start, end) substring
+bool testWildCard(const std::string& str, size_t start, size_t end, CommandPart& wildCard);
 bool isWildCard(CommandPart& part);
-std::vector<std::string> expandWildCard (const CommandPart partToParse);
+// Counts the scanned directory entries if scannedEntries is given
+std::vector<std::string> expandWildCard (const CommandPart partToParse, size_t* scannedEntries=nullptr);
+// Calls onMatch for each matching file while the directory is scanned, returns the number of matches
+size_t forEachWildCardMatch(const CommandPart partToParse, const std::function<void(const std::string&)>& onMatch,
+                            size_t* scannedEntries=nullptr);
 
 #endif //MYSHELL_WILDCARDS_H
@@ -0,0 +1,44 @@
+#define _GNU_SOURCE
+#include "buffer_size.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+
+static const size_t min_buffer_size = 4 * 1024;
+static const size_t max_buffer_size = 1024 * 1024;
+// Larger buffers only waste memory, the kernel does not move more in one call
+static const size_t max_override_size = 1024 * 1024 * 1024;
+
+size_t parse_buffer_size(const char* value) {
+    char* end;
+    errno = 0;
+    unsigned long long size = strtoull(value, &end, 10);
+    if (errno || end == value || value[0] == '-') return 0;
+
+    if (*end == 'K' || *end == 'k') size *= 1024, ++end;
+    else if (*end == 'M' || *end == 'm') size *= 1024 * 1024, ++end;
+    else if (*end == 'G' || *end == 'g') size *= 1024 * 1024 * 1024, ++end;
+    if (*end || !size || size > max_override_size) return 0;
+    return size < min_buffer_size ? min_buffer_size : (size_t) size;
+}
+
+size_t choose_buffer_size(size_t largest_file, size_t block_size) {
+    if (block_size < min_buffer_size) block_size = min_buffer_size;
+    if (block_size > max_buffer_size) block_size = max_buffer_size;
+    if (largest_file >= max_buffer_size) return max_buffer_size;
+
+    size_t size = (largest_file + block_size - 1) / block_size * block_size;
+    return size < block_size ? block_size : size;
+}
+
+size_t fit_pipe(int file, size_t buffer_size) {
+    int capacity = fcntl(file, F_GETPIPE_SZ);
+    if (capacity < 0) return 0;
+    if ((size_t) capacity >= buffer_size || buffer_size > INT_MAX) return capacity;
+
+    // may be refused above /proc/sys/fs/pipe-max-size, the pipe then stays as it is
+    int grown = fcntl(file, F_SETPIPE_SZ, (int) buffer_size);
+    return grown < 0 ? (size_t) capacity : (size_t) grown;
+}
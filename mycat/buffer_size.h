@@ -0,0 +1,17 @@
+#ifndef MYCAT_BUFFER_SIZE_H
+#define MYCAT_BUFFER_SIZE_H
+
+#include <stddef.h>
+
+// Parses the -B value, a number of bytes with an optional K, M or G suffix. 0 if invalid
+size_t parse_buffer_size(const char* value);
+
+// At least one block of the file system, at most the largest input rounded up to the block
+// size, so that small files do not pay for a large allocation
+size_t choose_buffer_size(size_t largest_file, size_t block_size);
+
+// If the file is a pipe, tries to grow it to hold a whole buffer
+// Returns the pipe capacity or 0 if the file is not a pipe
+size_t fit_pipe(int file, size_t buffer_size);
+
+#endif //MYCAT_BUFFER_SIZE_H
@@ -0,0 +1,391 @@
+#include "escape.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ESCAPE_X86
+#include <immintrin.h>
+#endif
+
+static const char* hex_map = "0123456789ABCDEF";
+
+// isgraph or isspace in the C locale
+static int is_printable(unsigned char c) {
+    return (c >= 0x20 && c <= 0x7E) || (c >= '\t' && c <= '\r');
+}
+
+static char* escape_byte(unsigned char c, char* buffer_to) {
+    buffer_to[0] = '\\';
+    buffer_to[1] = 'x';
+    buffer_to[2] = hex_map[c / 16];
+    buffer_to[3] = hex_map[c % 16];
+    return buffer_to + 4;
+}
+
+size_t escape_scalar(const char* buffer_from, size_t buffer_from_size, char* buffer_to) {
+    char* to = buffer_to;
+    for (size_t i = 0; i < buffer_from_size; ++i) {
+        if (is_printable((unsigned char) buffer_from[i])) *to++ = buffer_from[i];
+        else to = escape_byte((unsigned char) buffer_from[i], to);
+    }
+    return to - buffer_to;
+}
+
+// Escapes the block, bit i of printable_mask tells if byte i is copied as is
+static char* escape_block(const char* block, size_t block_size, uint32_t printable_mask, char* to) {
+    for (size_t i = 0; i < block_size; ++i) {
+        if (printable_mask >> i & 1) *to++ = block[i];
+        else to = escape_byte((unsigned char) block[i], to);
+    }
+    return to;
+}
+
+// Length of the valid sequence at from, 0 if more than available bytes are needed to tell, -1 if invalid
+static int utf8_sequence(const unsigned char* from, size_t available) {
+    unsigned char lead = from[0];
+    if (lead < 0x80) return 1;
+
+    int length;
+    unsigned char second_min = 0x80, second_max = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+    else if (lead >= 0xE0 && lead <= 0xEF) length = 3;
+    else if (lead >= 0xF0 && lead <= 0xF4) length = 4;
+    else return -1;
+
+    // the overlong forms, the surrogates and the code points above U+10FFFF
+    if (lead == 0xE0) second_min = 0xA0;
+    else if (lead == 0xED) second_max = 0x9F;
+    else if (lead == 0xF0) second_min = 0x90;
+    else if (lead == 0xF4) second_max = 0x8F;
+
+    for (int i = 1; i < length; ++i) {
+        if ((size_t) i >= available) return 0;
+        unsigned char min = i == 1 ? second_min : 0x80, max = i == 1 ? second_max : 0xBF;
+        if (from[i] < min || from[i] > max) return -1;
+    }
+    return length;
+}
+
+// C0 controls other than white space, DEL and the C1 controls U+0080-U+009F
+static int is_control_sequence(const unsigned char* sequence, int length) {
+    if (length == 1) return !is_printable(sequence[0]);
+    return length == 2 && sequence[0] == 0xC2 && sequence[1] < 0xA0;
+}
+
+// Processes from[0, size) up to a sequence that is not finished yet unless final, returns the end of the output
+static char* escape_utf8_range(const unsigned char* from, size_t size, size_t* consumed, char* to, int final) {
+    size_t i = 0;
+    while (i < size) {
+        int length = utf8_sequence(from + i, size - i);
+        if (!length && !final) break;
+        if (length <= 0) {
+            to = escape_byte(from[i++], to);
+        } else if (is_control_sequence(from + i, length)) {
+            for (int j = 0; j < length; ++j) to = escape_byte(from[i++], to);
+        } else {
+            memcpy(to, from + i, length);
+            to += length;
+            i += length;
+        }
+    }
+    *consumed = i;
+    return to;
+}
+
+// Finishes the pending sequence with the first bytes of the input, returns the number of input bytes used
+static size_t escape_utf8_pending(struct utf8_state* state, const unsigned char* from, size_t size, char** to) {
+    if (!state->pending_size) return 0;
+
+    unsigned char sequence[6];
+    size_t taken = size < 3 ? size : 3;
+    memcpy(sequence, state->pending, state->pending_size);
+    memcpy(sequence + state->pending_size, from, taken);
+    size_t available = state->pending_size + taken;
+
+    int length = utf8_sequence(sequence, available);
+    if (!length) {
+        // still not finished, the whole input is a part of it
+        memcpy(state->pending + state->pending_size, from, size);
+        state->pending_size += size;
+        return size;
+    }
+
+    size_t pending_size = state->pending_size;
+    state->pending_size = 0;
+    if (length < 0) {
+        // the pending bytes are a lead byte with continuations, none of them is valid alone
+        for (size_t i = 0; i < pending_size; ++i) *to = escape_byte(state->pending[i], *to);
+        return 0;
+    }
+    size_t used;
+    *to = escape_utf8_range(sequence, length, &used, *to, 1);
+    return length - pending_size;
+}
+
+static size_t keep_pending(struct utf8_state* state, const unsigned char* from, size_t size) {
+    memcpy(state->pending, from, size);
+    state->pending_size = size;
+    return size;
+}
+
+size_t escape_utf8_scalar(struct utf8_state* state, const char* buffer_from, size_t buffer_from_size, char* buffer_to) {
+    const unsigned char* from = (const unsigned char*) buffer_from;
+    char* to = buffer_to;
+    size_t i = escape_utf8_pending(state, from, buffer_from_size, &to);
+    if (state->pending_size) return to - buffer_to;
+
+    size_t consumed;
+    to = escape_utf8_range(from + i, buffer_from_size - i, &consumed, to, 0);
+    i += consumed;
+    keep_pending(state, from + i, buffer_from_size - i);
+    return to - buffer_to;
+}
+
+size_t escape_utf8_finish(struct utf8_state* state, char* buffer_to) {
+    size_t consumed;
+    char* to = escape_utf8_range(state->pending, state->pending_size, &consumed, buffer_to, 1);
+    state->pending_size = 0;
+    return to - buffer_to;
+}
+
+// Number of bytes before end that start a sequence not finished by end
+static size_t unfinished_tail(const unsigned char* end, size_t available) {
+    for (size_t j = 1; j <= 3 && j <= available; ++j) {
+        unsigned char c = end[-(ptrdiff_t) j];
+        if (c < 0x80) return 0;
+        if (c >= 0xC0) {
+            size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+            return length > j ? j : 0;
+        }
+    }
+    return 0;
+}
+
+#ifdef ESCAPE_X86
+
+// The vector compares are signed, so the bytes above 0x7F are never printable
+static size_t escape_sse2(const char* buffer_from, size_t buffer_from_size, char* buffer_to) {
+    const __m128i space_low = _mm_set1_epi8(0x1F), space_high = _mm_set1_epi8(0x7F);
+    const __m128i tab_low = _mm_set1_epi8('\t' - 1), tab_high = _mm_set1_epi8('\r' + 1);
+
+    char* to = buffer_to;
+    size_t i = 0;
+    for (; i + 16 <= buffer_from_size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (buffer_from + i));
+        __m128i visible = _mm_and_si128(_mm_cmpgt_epi8(block, space_low), _mm_cmplt_epi8(block, space_high));
+        __m128i white = _mm_and_si128(_mm_cmpgt_epi8(block, tab_low), _mm_cmplt_epi8(block, tab_high));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(_mm_or_si128(visible, white));
+
+        if (mask == 0xFFFF) {
+            _mm_storeu_si128((__m128i*) to, block);
+            to += 16;
+        } else {
+            to = escape_block(buffer_from + i, 16, mask, to);
+        }
+    }
+    return (to - buffer_to) + escape_scalar(buffer_from + i, buffer_from_size - i, to);
+}
+
+__attribute__((target("avx2")))
+static size_t escape_avx2(const char* buffer_from, size_t buffer_from_size, char* buffer_to) {
+    const __m256i space_low = _mm256_set1_epi8(0x1F), space_high = _mm256_set1_epi8(0x7F);
+    const __m256i tab_low = _mm256_set1_epi8('\t' - 1), tab_high = _mm256_set1_epi8('\r' + 1);
+
+    char* to = buffer_to;
+    size_t i = 0;
+    for (; i + 32 <= buffer_from_size; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*) (buffer_from + i));
+        __m256i visible = _mm256_and_si256(_mm256_cmpgt_epi8(block, space_low), _mm256_cmpgt_epi8(space_high, block));
+        __m256i white = _mm256_and_si256(_mm256_cmpgt_epi8(block, tab_low), _mm256_cmpgt_epi8(tab_high, block));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(visible, white));
+
+        if (mask == 0xFFFFFFFF) {
+            _mm256_storeu_si256((__m256i*) to, block);
+            to += 32;
+        } else {
+            to = escape_block(buffer_from + i, 32, mask, to);
+        }
+    }
+    return (to - buffer_to) + escape_sse2(buffer_from + i, buffer_from_size - i, to);
+}
+
+// Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte": every error is found
+// from the high and low nibble of the previous byte and the high nibble of the current one
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+__attribute__((target("avx2")))
+static __m256i shift_in(__m256i input, __m256i previous, int n) {
+    __m256i joined = _mm256_permute2x128_si256(previous, input, 0x21);
+    switch (n) {
+        case 1: return _mm256_alignr_epi8(input, joined, 15);
+        case 2: return _mm256_alignr_epi8(input, joined, 14);
+        default: return _mm256_alignr_epi8(input, joined, 13);
+    }
+}
+
+__attribute__((target("avx2")))
+static __m256i lookup16(__m256i table, __m256i nibbles) {
+    return _mm256_shuffle_epi8(table, nibbles);
+}
+
+// Non zero bytes where the block is not valid UTF-8, starts a C1 control or has a C0 control or DEL
+__attribute__((target("avx2")))
+static __m256i utf8_errors(__m256i input, __m256i previous) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte_1_high_table = _mm256_setr_epi8(
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m256i byte_1_low_table = _mm256_setr_epi8(
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+            CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+            CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m256i byte_2_high_table = _mm256_setr_epi8(
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    __m256i previous_1 = shift_in(input, previous, 1);
+    __m256i byte_1_high = lookup16(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(previous_1, 4), low_nibble));
+    __m256i byte_1_low = lookup16(byte_1_low_table, _mm256_and_si256(previous_1, low_nibble));
+    __m256i byte_2_high = lookup16(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble));
+    __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // the third and the fourth bytes of the sequences must be continuations
+    __m256i third = _mm256_subs_epu8(shift_in(input, previous, 2), _mm256_set1_epi8((char) (0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(shift_in(input, previous, 3), _mm256_set1_epi8((char) (0xF0 - 0x80)));
+    __m256i must_be_continuation = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char) 0x80));
+    __m256i errors = _mm256_xor_si256(must_be_continuation, special_cases);
+
+    // C0 controls without white space and DEL, the signed compare keeps the bytes above 0x7F out
+    __m256i c0 = _mm256_andnot_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), input)),
+            _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), input), _mm256_cmpgt_epi8(input, _mm256_set1_epi8(-1))));
+    __m256i del = _mm256_cmpeq_epi8(input, _mm256_set1_epi8(0x7F));
+    // C1 controls are 0xC2 followed by 0x80-0x9F
+    __m256i c1 = _mm256_and_si256(_mm256_cmpeq_epi8(previous_1, _mm256_set1_epi8((char) 0xC2)),
+                                  _mm256_cmpgt_epi8(_mm256_set1_epi8((char) 0xA0), input));
+    return _mm256_or_si256(errors, _mm256_or_si256(c0, _mm256_or_si256(del, c1)));
+}
+
+// The valid blocks are copied as is. A block with an error is redone by the scalar kernel from the start of
+// the sequence that reaches into it, that is possible because the valid blocks before took the same space.
+__attribute__((target("avx2")))
+static size_t escape_utf8_avx2(struct utf8_state* state, const char* buffer_from, size_t buffer_from_size,
+                               char* buffer_to) {
+    const unsigned char* from = (const unsigned char*) buffer_from;
+    char* to = buffer_to;
+    size_t i = escape_utf8_pending(state, from, buffer_from_size, &to);
+    if (state->pending_size) return to - buffer_to;
+
+    __m256i previous = _mm256_setzero_si256();
+    // the sequences before i are not finished only if i is reached by a copied block
+    int after_block = 0;
+    while (i + 32 <= buffer_from_size) {
+        __m256i block = _mm256_loadu_si256((const __m256i*) (from + i));
+        __m256i errors = utf8_errors(block, previous);
+        if (_mm256_testz_si256(errors, errors)) {
+            _mm256_storeu_si256((__m256i*) to, block);
+            to += 32;
+            i += 32;
+            previous = block;
+            after_block = 1;
+            continue;
+        }
+
+        size_t tail = after_block ? unfinished_tail(from + i, i) : 0;
+        to -= tail;
+        size_t consumed;
+        to = escape_utf8_range(from + i - tail, 32 + tail, &consumed, to, 0);
+        i = i - tail + consumed;
+        previous = _mm256_setzero_si256();
+        after_block = 0;
+        // finish the sequence that crosses the end of the block
+        if (consumed < 32 + tail) {
+            to = escape_utf8_range(from + i, buffer_from_size - i < 4 ? buffer_from_size - i : 4, &consumed, to, 0);
+            if (!consumed) break;
+            i += consumed;
+        }
+    }
+
+    size_t tail = after_block ? unfinished_tail(from + i, i) : 0;
+    to -= tail;
+    i -= tail;
+    size_t consumed;
+    to = escape_utf8_range(from + i, buffer_from_size - i, &consumed, to, 0);
+    i += consumed;
+    keep_pending(state, from + i, buffer_from_size - i);
+    return to - buffer_to;
+}
+
+#endif
+
+escape_utf8_function select_escape_utf8(void) {
+    const char* forced = getenv("MYCAT_ESCAPE");
+    if (forced && !strcmp(forced, "scalar")) return escape_utf8_scalar;
+#ifdef ESCAPE_X86
+    __builtin_cpu_init();
+    int has_avx2 = __builtin_cpu_supports("avx2");
+    // there is no SSE2 validator, the lookups need pshufb
+    if (forced && !strcmp(forced, "sse2")) return escape_utf8_scalar;
+    if (forced && !strcmp(forced, "avx2")) return has_avx2 ? escape_utf8_avx2 : NULL;
+    if (forced) return NULL;
+    return has_avx2 ? escape_utf8_avx2 : escape_utf8_scalar;
+#else
+    return forced ? NULL : escape_utf8_scalar;
+#endif
+}
+
+escape_function select_escape(void) {
+    const char* forced = getenv("MYCAT_ESCAPE");
+    if (forced && !strcmp(forced, "scalar")) return escape_scalar;
+#ifdef ESCAPE_X86
+    __builtin_cpu_init();
+    int has_sse2 = __builtin_cpu_supports("sse2");
+    int has_avx2 = __builtin_cpu_supports("avx2");
+    if (forced && !strcmp(forced, "sse2")) return has_sse2 ? escape_sse2 : NULL;
+    if (forced && !strcmp(forced, "avx2")) return has_avx2 ? escape_avx2 : NULL;
+    if (forced) return NULL;
+    if (has_avx2) return escape_avx2;
+    if (has_sse2) return escape_sse2;
+    return escape_scalar;
+#else
+    return forced ? NULL : escape_scalar;
+#endif
+}
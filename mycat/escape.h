@@ -0,0 +1,37 @@
+#ifndef MYCAT_ESCAPE_H
+#define MYCAT_ESCAPE_H
+
+#include <stddef.h>
+
+// Copies buffer_from to buffer_to replacing every byte that is not printable or white space
+// in the C locale with \xHH. buffer_to must have space for 4 * buffer_from_size bytes.
+// Returns the number of bytes written.
+typedef size_t (*escape_function)(const char* buffer_from, size_t buffer_from_size, char* buffer_to);
+
+// Reference implementation, one byte at a time
+size_t escape_scalar(const char* buffer_from, size_t buffer_from_size, char* buffer_to);
+
+// The fastest kernel supported by the cpu. MYCAT_ESCAPE=scalar|sse2|avx2 forces the kernel,
+// NULL if the forced kernel is unknown or not supported.
+escape_function select_escape(void);
+
+// UTF-8 mode: valid sequences are copied as is, invalid bytes and control characters
+// (C0, DEL and C1) are escaped. A sequence split by the end of the buffer is kept in the state
+// until the next call. buffer_to must have space for 4 * (buffer_from_size + 3) bytes.
+struct utf8_state {
+    unsigned char pending[3];
+    size_t pending_size;
+};
+
+typedef size_t (*escape_utf8_function)(struct utf8_state* state, const char* buffer_from, size_t buffer_from_size,
+                                      char* buffer_to);
+
+// Reference implementation, one sequence at a time
+size_t escape_utf8_scalar(struct utf8_state* state, const char* buffer_from, size_t buffer_from_size, char* buffer_to);
+// Escapes the sequence left unfinished at the end of the input
+size_t escape_utf8_finish(struct utf8_state* state, char* buffer_to);
+
+// Same as select_escape, the AVX2 kernel validates 32 bytes at a time with nibble lookup tables
+escape_utf8_function select_escape_utf8(void);
+
+#endif //MYCAT_ESCAPE_H
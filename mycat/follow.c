@@ -0,0 +1,149 @@
+#include "follow.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "filef.h"
+#include "reader.h"
+
+struct followed_file {
+    const char* name;
+    // the name inside the directory, compared with the directory events
+    const char* base;
+    int file;
+    dev_t device;
+    ino_t inode;
+    int watch;
+    int directory_watch;
+};
+
+static const unsigned file_events = IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF;
+// a rotated file is replaced by a new one under the same name
+static const unsigned directory_events = IN_CREATE | IN_MOVED_TO;
+
+// The watch is added before the file is copied, so that no write is missed
+static int open_followed(struct followed_file* followed, int notify) {
+    followed->file = open_input(followed->name, 0);
+    struct stat file_stat;
+    if (followed->file < 0 || fstat(followed->file, &file_stat) < 0) return -1;
+
+    followed->device = file_stat.st_dev;
+    followed->inode = file_stat.st_ino;
+    followed->watch = inotify_add_watch(notify, followed->name, file_events);
+    return followed->watch < 0 ? -3 : 0;
+}
+
+static int watch_directory(struct followed_file* followed, int notify) {
+    const char* slash = strrchr(followed->name, '/');
+    followed->base = slash ? slash + 1 : followed->name;
+    if (!slash) {
+        followed->directory_watch = inotify_add_watch(notify, ".", directory_events);
+    } else {
+        size_t length = slash == followed->name ? 1 : (size_t) (slash - followed->name);
+        char* directory = malloc(length + 1);
+        if (!directory) return -3;
+        memcpy(directory, followed->name, length);
+        directory[length] = '\0';
+        followed->directory_watch = inotify_add_watch(notify, directory, directory_events);
+        free(directory);
+    }
+    return followed->directory_watch < 0 ? -3 : 0;
+}
+
+// A file that got shorter than what was copied was truncated, it is copied again from the start
+static void check_truncated(struct followed_file* followed) {
+    struct stat file_stat;
+    off_t offset = lseek(followed->file, 0, SEEK_CUR);
+    if (offset < 0 || fstat(followed->file, &file_stat) < 0 || file_stat.st_size >= offset) return;
+
+    filef(STDERR_FILENO, "mycat: %s: file truncated\n", followed->name);
+    lseek(followed->file, 0, SEEK_SET);
+}
+
+// Finishes the old file and continues with the new one if another inode has the name now
+static int check_replaced(struct followed_file* followed, int notify, follow_copy_function copy) {
+    struct stat name_stat;
+    if (stat(followed->name, &name_stat) < 0) return 0;
+    if (name_stat.st_dev == followed->device && name_stat.st_ino == followed->inode) return 0;
+
+    int result;
+    if (followed->file >= 0) {
+        if ((result = copy(followed->file)) < 0) return result;
+        close(followed->file);
+    }
+    if (followed->watch >= 0) inotify_rm_watch(notify, followed->watch);
+    followed->watch = -1;
+
+    // the name may be replaced again before it is opened, the next event tells
+    if ((result = open_followed(followed, notify)) == -1) return 0;
+    return result < 0 ? result : copy(followed->file);
+}
+
+static int handle_event(struct inotify_event* event, struct followed_file* files, int filenum, int notify,
+                        follow_copy_function copy) {
+    for (int i = 0; i < filenum; ++i) {
+        struct followed_file* followed = &files[i];
+        int result = 0;
+
+        if (event->wd == followed->watch) {
+            if (event->mask & IN_IGNORED) {
+                followed->watch = -1;
+                continue;
+            }
+            if (event->mask & IN_MODIFY) check_truncated(followed);
+            result = copy(followed->file);
+            // renamed away, a new file may already be under the name
+            if (!result && event->mask & (IN_MOVE_SELF | IN_DELETE_SELF))
+                result = check_replaced(followed, notify, copy);
+        } else if (event->wd == followed->directory_watch && event->len && !strcmp(event->name, followed->base)) {
+            result = check_replaced(followed, notify, copy);
+        }
+        if (result < 0) return result;
+    }
+    return 0;
+}
+
+int follow_files(char** filenames, int filenum, follow_copy_function copy) {
+    int notify = inotify_init1(IN_CLOEXEC);
+    struct followed_file* files = calloc(filenum, sizeof(struct followed_file));
+    if (notify < 0 || !files) {
+        if (notify >= 0) close(notify);
+        free(files);
+        return -3;
+    }
+
+    int result = 0;
+    int opened = 0;
+    for (; opened < filenum && !result; ++opened) {
+        files[opened].name = filenames[opened];
+        if (!(result = open_followed(&files[opened], notify)) && !(result = watch_directory(&files[opened], notify)))
+            result = copy(files[opened].file);
+    }
+
+    // the events are read without a timeout, an idle file costs nothing
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (!result) {
+        ssize_t length = read(notify, events, sizeof(events));
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            result = -3;
+            break;
+        }
+        for (char* position = events; position < events + length && !result;) {
+            struct inotify_event* event = (struct inotify_event*) position;
+            result = handle_event(event, files, filenum, notify, copy);
+            position += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    for (int i = 0; i < opened; ++i) {
+        if (files[i].file >= 0) close(files[i].file);
+    }
+    free(files);
+    close(notify);
+    return result;
+}
@@ -0,0 +1,12 @@
+#ifndef MYCAT_FOLLOW_H
+#define MYCAT_FOLLOW_H
+
+// Copies the rest of the file from its current offset, returns -1 on a read error and -2 on a write error
+typedef int (*follow_copy_function)(int file_in);
+
+// Copies the files and then waits on inotify for them to grow, only the appended bytes are copied.
+// A truncated file is copied again from the start, a file replaced under its name (rotation) is
+// finished and the new one is opened. Returns only on error: -1 read, -2 write, -3 inotify.
+int follow_files(char** filenames, int filenum, follow_copy_function copy);
+
+#endif //MYCAT_FOLLOW_H
@@ -0,0 +1,76 @@
+#include "lines.h"
+
+#include <string.h>
+
+// Same as "%6llu\t"
+static const size_t number_width = 6;
+static const size_t max_number_length = 20 + 1;
+
+int line_options_enabled(const struct line_options* options) {
+    return options->number || options->number_nonblank || options->squeeze || options->show_ends;
+}
+
+void line_state_init(struct line_state* state) {
+    state->line = 0;
+    state->at_line_start = 1;
+    state->empty_lines = 0;
+}
+
+static int write_number(struct line_state* state, struct output* output) {
+    char* to = output_reserve(output, max_number_length);
+    if (!to) return -1;
+
+    char digits[20];
+    size_t length = 0;
+    unsigned long long number = ++state->line;
+    do {
+        digits[length++] = (char) ('0' + number % 10);
+        number /= 10;
+    } while (number);
+
+    size_t written = 0;
+    for (; written + length < number_width; ++written) to[written] = ' ';
+    while (length) to[written++] = digits[--length];
+    to[written++] = '\t';
+    output->size += written;
+    return 0;
+}
+
+static int write_line_end(const struct line_options* options, struct output* output) {
+    return options->show_ends ? output_write(output, "$\n", 2) : output_write(output, "\n", 1);
+}
+
+int format_lines(const struct line_options* options, struct line_state* state,
+                 const char* buffer, size_t buffer_size, struct output* output) {
+    int number_all = options->number && !options->number_nonblank;
+    const char* position = buffer;
+    const char* end = buffer + buffer_size;
+
+    while (position < end) {
+        if (state->at_line_start) {
+            if (*position == '\n') {
+                ++position;
+                if (options->squeeze && state->empty_lines) continue;
+                ++state->empty_lines;
+                if (number_all && write_number(state, output) < 0) return -1;
+                if (write_line_end(options, output) < 0) return -1;
+                continue;
+            }
+            state->empty_lines = 0;
+            state->at_line_start = 0;
+            if ((number_all || options->number_nonblank) && write_number(state, output) < 0) return -1;
+        }
+
+        // the rest of the line is copied at once
+        const char* line_end = memchr(position, '\n', end - position);
+        const char* part_end = line_end ? line_end : end;
+        if (output_write(output, position, part_end - position) < 0) return -1;
+        position = part_end;
+        if (line_end) {
+            ++position;
+            state->at_line_start = 1;
+            if (write_line_end(options, output) < 0) return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MYCAT_LINES_H
+#define MYCAT_LINES_H
+
+#include <stddef.h>
+#include "output.h"
+
+struct line_options {
+    // -n, number all the lines
+    int number;
+    // -b, number the non-empty lines, overrides -n
+    int number_nonblank;
+    // -s, print only one of the adjacent empty lines
+    int squeeze;
+    // -E, print $ at the end of every line
+    int show_ends;
+};
+
+// Carried between the buffers and the files, so that a line may span them
+struct line_state {
+    unsigned long long line;
+    int at_line_start;
+    unsigned long long empty_lines;
+};
+
+int line_options_enabled(const struct line_options* options);
+void line_state_init(struct line_state* state);
+// Writes the buffer with the line numbers and ends to the output, returns -1 if the write failed
+int format_lines(const struct line_options* options, struct line_state* state,
+                 const char* buffer, size_t buffer_size, struct output* output);
+
+#endif //MYCAT_LINES_H
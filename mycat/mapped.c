@@ -0,0 +1,45 @@
+#include "mapped.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The address space taken by one window, a multiple of any page size.
+// Small enough that a file changed while it is mapped is noticed soon.
+static const size_t window_size = 32 * 1024 * 1024;
+
+void mapped_window_init(struct mapped_window* window, int file, off_t file_size) {
+    window->file = file;
+    window->file_size = file_size;
+    window->offset = 0;
+    window->data = NULL;
+    window->size = 0;
+}
+
+int mapped_window_next(struct mapped_window* window) {
+    off_t offset = window->offset + window->size;
+    mapped_window_close(window);
+    window->offset = offset;
+    if (mapped_window_changed(window)) return -1;
+    if (offset >= window->file_size) return 0;
+
+    off_t left = window->file_size - offset;
+    size_t size = left < (off_t) window_size ? (size_t) left : window_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, window->file, offset);
+    if (data == MAP_FAILED) return -1;
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    window->data = data;
+    window->size = size;
+    return 1;
+}
+
+int mapped_window_changed(struct mapped_window* window) {
+    struct stat file_stat;
+    return fstat(window->file, &file_stat) < 0 || file_stat.st_size != window->file_size;
+}
+
+void mapped_window_close(struct mapped_window* window) {
+    if (window->data) munmap(window->data, window->size);
+    window->data = NULL;
+    window->size = 0;
+}
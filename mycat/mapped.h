@@ -0,0 +1,25 @@
+#ifndef MYCAT_MAPPED_H
+#define MYCAT_MAPPED_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Maps a file one window after another, so that large files do not take the whole address space
+struct mapped_window {
+    int file;
+    off_t file_size;
+    off_t offset;
+    char* data;
+    size_t size;
+};
+
+void mapped_window_init(struct mapped_window* window, int file, off_t file_size);
+// Unmaps the previous window and maps the next part of the file for a sequential read
+// Returns 1 if a window is mapped, 0 at the end of the file and -1 if mmap failed or the size of the file changed
+int mapped_window_next(struct mapped_window* window);
+// Whether the size of the file differs from the one at open time, a file that shrank
+// would fault on the mapped pages past its end, so it has to be read instead
+int mapped_window_changed(struct mapped_window* window);
+void mapped_window_close(struct mapped_window* window);
+
+#endif //MYCAT_MAPPED_H
@@ -2,13 +2,22 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <ctype.h>
 #include <string.h>
 #include <sys/stat.h>
 
 #include "filef.h"
+#include "zero_copy.h"
+#include "escape.h"
+#include "reader.h"
+#include "mapped.h"
+#include "output.h"
+#include "lines.h"
+#include "buffer_size.h"
+#include "pool.h"
+#include "follow.h"
 
-const size_t buffer_char_number = 1024 * 1024;
+// Chosen for the inputs unless -B is given
+size_t buffer_char_number = 1024 * 1024;
 
 ssize_t read_to_buffer(int file, char* buffer, size_t buffer_size) {
     size_t total_number_read = 0;
@@ -28,62 +37,330 @@ ssize_t read_to_buffer(int file, char* buffer, size_t buffer_size) {
     return total_number_read;
 };
 
-ssize_t write_from_buffer(int file, char* buffer, size_t buffer_size) {
-    size_t total_number_written = 0;
+// NULL if the data is copied as is
+static escape_function transform = NULL;
+// -U, the state keeps the sequences split between the buffers
+static escape_utf8_function transform_utf8 = NULL;
+static struct utf8_state utf8_state;
+// -j, transforms the buffers of -A on several threads, NULL for a single thread
+static struct transform_pool* pool = NULL;
+static int transform_threads = 1;
+static struct line_options line_options;
+static struct line_state line_state;
+// Collects the line numbers and the lines, NULL without the line options
+static struct output* line_output = NULL;
+// Number of buffers the reader thread can fill ahead of the writes
+static const int read_ahead_buffers = 4;
+// Smaller files are read, the larger ones are mapped
+static const off_t mmap_threshold = 16 * 1024 * 1024;
 
-    while (total_number_written < buffer_size) {
-        ssize_t number_written = write(file, &buffer[total_number_written], buffer_size - total_number_written);
-        if (number_written < 0) {
-            if (errno != EINTR) return -1;
-        } else {
-            total_number_written += number_written;
+int copy_file(int file_in, int file_out, char* buffer, size_t buffer_size) {
+    ssize_t number_read;
+
+    int result = zero_copy_file(file_in, file_out);
+    if (result <= 0) return result;
+
+    while ((number_read = read_to_buffer(file_in, buffer, buffer_size))) {
+        if (number_read < 0) return -1;
+        if (write_from_buffer(file_out, buffer, number_read) < 0) return -2;
+    };
+
+    return 0;
+}
+
+// Every file is copied inside the kernel, the next one is opened and prefetched meanwhile
+int copy_files_zero_copy(char** filenames, int filenum, int file_out) {
+    char* buffer = malloc(buffer_char_number);
+    if (!buffer) {
+        filef(STDERR_FILENO, "Cannot allocate memory for copying the files\n");
+        return 3;
+    }
+
+    int next_file = open_input(filenames[0], 0);
+    for (int i = 0; i < filenum; ++i) {
+        int file = next_file;
+        next_file = i + 1 < filenum ? open_input(filenames[i + 1], 1) : -1;
+        if (file < 0) {
+            filef(STDERR_FILENO, "Cannot open file %s\n", filenames[i]);
+            break;
+        }
+
+        int result = copy_file(file, file_out, buffer, buffer_char_number);
+        close(file);
+        if (result == -1) {
+            filef(STDERR_FILENO, "Cannot read file %s\n", filenames[i]);
+            break;
+        } else if (result == -2) {
+            filef(STDERR_FILENO, "Cannot write to resulting file\n");
+            break;
         }
     }
 
-    return total_number_written;
+    if (next_file >= 0) close(next_file);
+    free(buffer);
+    return 0;
+}
+
+size_t escape_utf8_stream(const char* buffer_from, size_t buffer_from_size, char* buffer_to) {
+    return transform_utf8(&utf8_state, buffer_from, buffer_from_size, buffer_to);
+}
+
+// Returns -2 if the write failed
+int write_output(int file_out, const char* data, size_t size) {
+    if (line_output) return format_lines(&line_options, &line_state, data, size, line_output) < 0 ? -2 : 0;
+    return write_from_buffer(file_out, data, size) < 0 ? -2 : 0;
 }
 
-size_t transform(const char* buffer_from, size_t buffer_from_size, char* buffer_to) {
-    static const char* hex_map = "0123456789ABCDEF";
+int write_transformed(int file_out, const char* data, size_t size, char* transform_buffer) {
+    if (transform) {
+        size = transform(data, size, transform_buffer);
+        data = transform_buffer;
+    }
+    return write_output(file_out, data, size);
+}
+
+// Writes the oldest job of the pool, its tag tells whether it holds a reader chunk
+int write_oldest_job(int file_out, struct reader* reader) {
+    struct transform_job* job = pool_oldest(pool);
+    int result = write_output(file_out, job->output, job->output_size);
+    int holds_chunk = job->tag;
+    pool_release(pool);
+    if (holds_chunk) reader_release(reader);
+    return result;
+}
+
+int write_all_jobs(int file_out, struct reader* reader) {
+    while (pool_in_flight(pool)) {
+        if (write_oldest_job(file_out, reader) < 0) return -2;
+    }
+    return 0;
+}
+
+// Transforms size bytes on the pool if there is one, the data must stay valid until the pool is empty
+int write_parallel(int file_out, const char* data, size_t size, char* transform_buffer) {
+    if (!pool) return write_transformed(file_out, data, size, transform_buffer);
+
+    if (pool_in_flight(pool) == pool->job_number && write_oldest_job(file_out, NULL) < 0) return -2;
+    pool_submit(pool, data, size, 0);
+    return 0;
+}
+
+// The transformation reads straight from the mapping. The size of the file is checked before each
+// buffer is transformed, from a file that changed the rest is read instead into a buffer allocated then.
+int copy_mapped_file(int file_in, off_t file_size, int file_out, char* transform_buffer) {
+    struct mapped_window window;
+    mapped_window_init(&window, file_in, file_size);
+
+    int mapped;
+    while ((mapped = mapped_window_next(&window)) > 0) {
+        size_t offset = 0;
+        while (offset < window.size && !mapped_window_changed(&window)) {
+            size_t size = window.size - offset < buffer_char_number ? window.size - offset : buffer_char_number;
+            if (write_parallel(file_out, window.data + offset, size, transform_buffer) < 0) {
+                if (pool) pool_discard(pool);
+                mapped_window_close(&window);
+                return -2;
+            }
+            offset += size;
+        }
+        // the jobs read from the window
+        if (pool && write_all_jobs(file_out, NULL) < 0) {
+            pool_discard(pool);
+            mapped_window_close(&window);
+            return -2;
+        }
+        if (offset < window.size) {
+            off_t position = window.offset + offset;
+            mapped_window_close(&window);
+            window.offset = position;
+            mapped = -1;
+            break;
+        }
+    }
+    if (!mapped) return 0;
+
+    // continue with read from where the mapping stopped, this also takes the appended data
+    if (lseek(file_in, window.offset, SEEK_SET) < 0) return -1;
+    char* buffer = malloc(buffer_char_number);
+    if (!buffer) return -1;
+    ssize_t number_read;
+    int result = 0;
+    while ((number_read = read_to_buffer(file_in, buffer, buffer_char_number))) {
+        if (number_read < 0) {
+            result = -1;
+            break;
+        }
+        if (write_transformed(file_out, buffer, number_read, transform_buffer) < 0) {
+            result = -2;
+            break;
+        }
+    }
+    free(buffer);
+    return result;
+}
+
+// The files are read on the reader thread, while the previous buffers are transformed and written
+int copy_files_pipelined(char** filenames, int filenum, int file_out) {
+    struct reader reader;
+    // a sequence of up to 3 bytes may be left from the previous buffer in the UTF-8 mode
+    char* transform_buffer = transform ? malloc(4 * (buffer_char_number + 3)) : NULL;
+    if ((transform && !transform_buffer) ||
+        reader_start(&reader, filenames, filenum, buffer_char_number, read_ahead_buffers + 2 * transform_threads,
+                     mmap_threshold)) {
+        filef(STDERR_FILENO, "Cannot allocate memory for copying the files\n");
+        free(transform_buffer);
+        return 3;
+    }
+
+    struct output output;
+    if (line_options_enabled(&line_options)) {
+        if (output_init(&output, file_out, buffer_char_number)) {
+            filef(STDERR_FILENO, "Cannot allocate memory for copying the files\n");
+            reader_stop(&reader);
+            free(transform_buffer);
+            return 3;
+        }
+        line_state_init(&line_state);
+        line_output = &output;
+    }
 
-    size_t i_to = 0;
-    for (size_t i = 0; i < buffer_from_size; ++i) {
-        if (isgraph(buffer_from[i]) || isspace(buffer_from[i])) {
-            buffer_to[i_to] = buffer_from[i];
-            ++i_to;
+    struct transform_pool transform_pool;
+    if (transform_threads > 1 && transform != escape_utf8_stream) {
+        if (pool_start(&transform_pool, transform_threads, 2 * transform_threads, buffer_char_number, transform)) {
+            filef(STDERR_FILENO, "Cannot start the transform threads\n");
         } else {
-            buffer_to[i_to] = '\\';
-            buffer_to[i_to + 1] = 'x';
-            buffer_to[i_to + 2] = hex_map[(unsigned char) buffer_from[i] / 16];
-            buffer_to[i_to + 3] = hex_map[(unsigned char) buffer_from[i] % 16];
-            i_to += 4;
+            pool = &transform_pool;
+        }
+    }
+
+    for (;;) {
+        struct reader_chunk* chunk;
+        if (pool) {
+            // the chunks in the pool are released when they are written
+            chunk = reader_peek(&reader, pool_in_flight(pool));
+            if (chunk->status == READER_DATA) {
+                if (pool_in_flight(pool) < pool->job_number) {
+                    pool_submit(pool, chunk->data, chunk->size, 1);
+                    continue;
+                }
+                if (write_oldest_job(file_out, &reader) == 0) continue;
+                filef(STDERR_FILENO, "Cannot write to resulting file\n");
+                break;
+            }
+            if (write_all_jobs(file_out, &reader) < 0) {
+                filef(STDERR_FILENO, "Cannot write to resulting file\n");
+                break;
+            }
+        }
+
+        chunk = reader_next(&reader);
+        if (chunk->status == READER_END) {
+            break;
+        } else if (chunk->status == READER_OPEN_ERROR) {
+            filef(STDERR_FILENO, "Cannot open file %s\n", filenames[chunk->file_index]);
+            break;
+        } else if (chunk->status == READER_READ_ERROR) {
+            filef(STDERR_FILENO, "Cannot read file %s\n", filenames[chunk->file_index]);
+            break;
+        }
+
+        int result = 0;
+        if (chunk->status == READER_MAPPED) {
+            result = copy_mapped_file(chunk->file, chunk->file_size, file_out, transform_buffer);
+            close(chunk->file);
+            chunk->file = -1;
+        } else {
+            result = write_transformed(file_out, chunk->data, chunk->size, transform_buffer);
+        }
+
+        if (result == -1) {
+            filef(STDERR_FILENO, "Cannot read file %s\n", filenames[chunk->file_index]);
+            break;
+        } else if (result == -2) {
+            filef(STDERR_FILENO, "Cannot write to resulting file\n");
+            break;
         }
+        reader_release(&reader);
     }
 
-    return i_to;
+    if (pool) {
+        // the jobs may read from the reader buffers
+        pool_stop(pool);
+        pool = NULL;
+    }
+    if (transform_utf8) {
+        // a sequence that is not finished at the end of the input is invalid
+        size_t size = escape_utf8_finish(&utf8_state, transform_buffer);
+        if (size && write_output(file_out, transform_buffer, size) < 0)
+            filef(STDERR_FILENO, "Cannot write to resulting file\n");
+    }
+    if (line_output) {
+        // the error of the previous write is already reported
+        output_flush(line_output);
+        output_free(line_output);
+        line_output = NULL;
+    }
+    reader_stop(&reader);
+    free(transform_buffer);
+    return 0;
 }
 
-int copy_file(int file_in, int file_out, char* buffer, size_t buffer_size, int formatHex) {
-    ssize_t number_read;
+// -f keeps copying what is appended to the files
+static char* follow_buffer;
+static char* follow_transform_buffer;
 
-    char* read_buffer = formatHex ? buffer + buffer_size * 3 : buffer;
-    while ((number_read = read_to_buffer(file_in, read_buffer, buffer_size))) {
-        if (number_read < 0) return -1;
-        size_t number_to_write = formatHex ? transform(read_buffer, number_read, buffer) : number_read;
-        if (write_from_buffer(file_out, buffer, number_to_write) < 0) return -2;
-    };
+int copy_appended(int file_in) {
+    if (!transform && !line_output) return copy_file(file_in, STDOUT_FILENO, follow_buffer, buffer_char_number);
 
+    ssize_t number_read;
+    while ((number_read = read_to_buffer(file_in, follow_buffer, buffer_char_number))) {
+        if (number_read < 0) return -1;
+        if (write_transformed(STDOUT_FILENO, follow_buffer, number_read, follow_transform_buffer) < 0) return -2;
+    }
+    // the lines are shown as soon as they are appended
+    if (line_output && output_flush(line_output) < 0) return -2;
     return 0;
 }
 
+int follow(char** filenames, int filenum) {
+    struct output output;
+    follow_buffer = malloc(buffer_char_number);
+    follow_transform_buffer = transform ? malloc(4 * (buffer_char_number + 3)) : NULL;
+    int has_output = line_options_enabled(&line_options) && !output_init(&output, STDOUT_FILENO, buffer_char_number);
+    if (!follow_buffer || (transform && !follow_transform_buffer) ||
+        (line_options_enabled(&line_options) && !has_output)) {
+        filef(STDERR_FILENO, "Cannot allocate memory for copying the files\n");
+        free(follow_buffer);
+        free(follow_transform_buffer);
+        if (has_output) output_free(&output);
+        return 3;
+    }
+    if (has_output) {
+        line_state_init(&line_state);
+        line_output = &output;
+    }
+
+    int result = follow_files(filenames, filenum, copy_appended);
+    if (result == -1) filef(STDERR_FILENO, "Cannot read the followed files\n");
+    else if (result == -2) filef(STDERR_FILENO, "Cannot write to resulting file\n");
+    else filef(STDERR_FILENO, "Cannot watch the files for changes\n");
+
+    if (has_output) output_free(&output);
+    line_output = NULL;
+    free(follow_buffer);
+    free(follow_transform_buffer);
+    return 4;
+}
+
 int main(int argc, char** argv) {
     char** filenames = malloc((argc - 1) * sizeof(char*));
-    int* files = malloc(sizeof(int) * (argc - 1));
     int filenum = 0;
     int help = 0;
     int formatHex = 0;
+    int follow_mode = 0;
+    size_t buffer_override = 0;
 
-    if (!filenames || !files) {
+    if (!filenames) {
         filef(STDERR_FILENO, "Cannot allocate memory\n");
         return 1;
     }
@@ -93,6 +370,32 @@ int main(int argc, char** argv) {
             help = 1;
         } else if (!strcmp(argv[i], "-A")) {
             formatHex = 1;
+        } else if (!strcmp(argv[i], "-U")) {
+            formatHex = 2;
+        } else if (!strcmp(argv[i], "-B")) {
+            if (i + 1 == argc || !(buffer_override = parse_buffer_size(argv[i + 1]))) {
+                filef(STDERR_FILENO, "Invalid buffer size\n");
+                free(filenames);
+                return 1;
+            }
+            ++i;
+        } else if (!strcmp(argv[i], "-j")) {
+            if (i + 1 == argc || (transform_threads = atoi(argv[i + 1])) < 1) {
+                filef(STDERR_FILENO, "Invalid number of threads\n");
+                free(filenames);
+                return 1;
+            }
+            ++i;
+        } else if (!strcmp(argv[i], "-f")) {
+            follow_mode = 1;
+        } else if (!strcmp(argv[i], "-n")) {
+            line_options.number = 1;
+        } else if (!strcmp(argv[i], "-b")) {
+            line_options.number_nonblank = 1;
+        } else if (!strcmp(argv[i], "-s")) {
+            line_options.squeeze = 1;
+        } else if (!strcmp(argv[i], "-E")) {
+            line_options.show_ends = 1;
         } else if (argv[i][0] == '-') {
             filef(STDERR_FILENO, "Invalid argument: %s\n", argv[i]);
         } else {
@@ -104,54 +407,62 @@ int main(int argc, char** argv) {
         const char* HELP_STR = "Usage: cat [OPTION]... [FILE]...\n"
                                "Concatenate FILE(s) to standard output.\n\n"
                                "\t-A,\tformat unprintable characters as hex codes\n"
+                               "\t-U,\tlike -A, but keep valid UTF-8 and escape only invalid bytes and control characters\n"
+                               "\t-B SIZE,\tuse SIZE bytes (K, M, G suffixes) for the buffers instead of choosing it\n"
+                               "\t-f,\tafter the end, wait for the files to grow and output the appended data\n"
+                               "\t-j N,\ttransform -A output on N threads\n"
+                               "\t-b,\tnumber nonempty output lines, overrides -n\n"
+                               "\t-E,\tdisplay $ at end of each line\n"
+                               "\t-n,\tnumber all output lines\n"
+                               "\t-s,\tsuppress repeated empty output lines\n"
                                "\t-h,\tprint the instructions and exit\n";
         filef(STDOUT_FILENO, "%s", HELP_STR);
         return 0;
     }
     if (!filenum) return 0;
 
-    for (int i = 0; i < filenum; ++i) {
-        files[i] = open(filenames[i], O_RDONLY);
+    if (formatHex == 2 && (transform_utf8 = select_escape_utf8())) {
+        transform = escape_utf8_stream;
+    } else if (formatHex == 1) {
+        transform = select_escape();
+    }
+    if (formatHex && !transform) {
+        filef(STDERR_FILENO, "Unsupported MYCAT_ESCAPE kernel: %s\n", getenv("MYCAT_ESCAPE"));
+        return 1;
+    }
 
+    // the files are only opened when they are copied, but are checked before anything is written
+    size_t largest_file = 0;
+    size_t block_size = 0;
+    for (int i = 0; i < filenum; ++i) {
         struct stat buf;
-        stat(filenames[i], &buf);
+        if (stat(filenames[i], &buf) < 0) {
+            filef(STDERR_FILENO, "Cannot open file %s\n", filenames[i]);
+            free(filenames);
+            return 2;
+        }
         if (!S_ISREG(buf.st_mode)) {
             filef(STDERR_FILENO, "File %s is not a regular file.\n", filenames[i]);
-            for (int j = 0; j < i; ++j) close(files[i]);
+            free(filenames);
             return 2;
         };
-
-        if (files[i] < 0) {
-            filef(STDERR_FILENO, "Cannot open file %s\n", filenames[i]);
-            for (int j = 0; j < i; ++j) close(files[i]);
-            return 2;
-        }
+        if ((size_t) buf.st_size > largest_file) largest_file = buf.st_size;
+        if ((size_t) buf.st_blksize > block_size) block_size = buf.st_blksize;
     }
 
-    char* buffer = formatHex ? malloc(4 * buffer_char_number) : malloc(buffer_char_number);
-    if (!buffer) {
-        filef(STDERR_FILENO, "Cannot allocate memory for copying the files\n");
-        for (int i = 0; i < filenum; ++i) close(files[i]);
-        return 3;
-    }
+    buffer_char_number = buffer_override ? buffer_override : choose_buffer_size(largest_file, block_size);
+    fit_pipe(STDOUT_FILENO, buffer_char_number);
 
-    for (int i = 0; i < filenum; ++i) {
-        int result = copy_file(files[i], STDOUT_FILENO, buffer, buffer_char_number, formatHex);
-
-        if (result == -1) {
-            filef(STDERR_FILENO, "Cannot read file %s\n", filenames[i]);
-            break;
-        } else if (result == -2) {
-            filef(STDERR_FILENO, "Cannot write to resulting file\n");
-            break;
-        }
+    if (follow_mode) {
+        int result = follow(filenames, filenum);
+        free(filenames);
+        return result;
     }
 
-    for (int i = 0; i < filenum; ++i) close(files[i]);
+    int result = !transform && !line_options_enabled(&line_options) && zero_copy_supported(STDOUT_FILENO) ?
+            copy_files_zero_copy(filenames, filenum, STDOUT_FILENO) :
+            copy_files_pipelined(filenames, filenum, STDOUT_FILENO);
 
     free(filenames);
-    free(files);
-    free(buffer);
-
-    return 0;
+    return result;
 }
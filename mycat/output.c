@@ -0,0 +1,57 @@
+#include "output.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+ssize_t write_from_buffer(int file, const char* buffer, size_t buffer_size) {
+    size_t total_number_written = 0;
+
+    while (total_number_written < buffer_size) {
+        ssize_t number_written = write(file, &buffer[total_number_written], buffer_size - total_number_written);
+        if (number_written < 0) {
+            if (errno != EINTR) return -1;
+        } else {
+            total_number_written += number_written;
+        }
+    }
+
+    return total_number_written;
+}
+
+int output_init(struct output* output, int file, size_t capacity) {
+    output->file = file;
+    output->size = 0;
+    output->capacity = capacity;
+    output->data = malloc(capacity);
+    return output->data ? 0 : -1;
+}
+
+void output_free(struct output* output) {
+    free(output->data);
+    output->data = NULL;
+}
+
+int output_flush(struct output* output) {
+    size_t size = output->size;
+    output->size = 0;
+    return write_from_buffer(output->file, output->data, size) < 0 ? -1 : 0;
+}
+
+int output_write(struct output* output, const char* data, size_t size) {
+    if (size >= output->capacity / 2) {
+        if (output_flush(output) < 0) return -1;
+        return write_from_buffer(output->file, data, size) < 0 ? -1 : 0;
+    }
+    if (output->size + size > output->capacity && output_flush(output) < 0) return -1;
+
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+    return 0;
+}
+
+char* output_reserve(struct output* output, size_t size) {
+    if (output->size + size > output->capacity && output_flush(output) < 0) return NULL;
+    return output->data + output->size;
+}
@@ -0,0 +1,28 @@
+#ifndef MYCAT_OUTPUT_H
+#define MYCAT_OUTPUT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Writes the whole buffer, returns -1 on error
+ssize_t write_from_buffer(int file, const char* buffer, size_t buffer_size);
+
+// Collects small pieces of output and writes them with one call
+struct output {
+    int file;
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+// Returns 0 on success
+int output_init(struct output* output, int file, size_t capacity);
+void output_free(struct output* output);
+// All the functions below return -1 if the write failed
+int output_flush(struct output* output);
+// Large pieces are written directly without the copy to the buffer
+int output_write(struct output* output, const char* data, size_t size);
+// Space for size bytes at output->data + output->size, size must not exceed the capacity
+char* output_reserve(struct output* output, size_t size);
+
+#endif //MYCAT_OUTPUT_H
@@ -0,0 +1,117 @@
+#include "pool.h"
+
+#include <stdlib.h>
+
+static void* transform_jobs(void* argument) {
+    struct transform_pool* pool = argument;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stopped && pool->taken == pool->submitted) pthread_cond_wait(&pool->job_submitted, &pool->lock);
+        if (pool->stopped) break;
+
+        struct transform_job* job = &pool->jobs[(pool->first + pool->taken++) % pool->job_number];
+        pthread_mutex_unlock(&pool->lock);
+        size_t output_size = pool->transform(job->input, job->input_size, job->output);
+        pthread_mutex_lock(&pool->lock);
+
+        job->output_size = output_size;
+        job->done = 1;
+        pthread_cond_broadcast(&pool->job_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void free_jobs(struct transform_pool* pool, int job_number) {
+    for (int i = 0; i < job_number; ++i) free(pool->jobs[i].output);
+    free(pool->jobs);
+    free(pool->threads);
+}
+
+int pool_start(struct transform_pool* pool, int thread_number, int job_number, size_t max_input,
+               escape_function transform) {
+    pool->transform = transform;
+    pool->thread_number = 0;
+    pool->job_number = job_number;
+    pool->first = pool->submitted = pool->taken = 0;
+    pool->stopped = 0;
+
+    pool->threads = malloc(thread_number * sizeof(pthread_t));
+    pool->jobs = calloc(job_number, sizeof(struct transform_job));
+    if (!pool->threads || !pool->jobs) {
+        free_jobs(pool, 0);
+        return -1;
+    }
+    for (int i = 0; i < job_number; ++i) {
+        if (!(pool->jobs[i].output = malloc(4 * max_input))) {
+            free_jobs(pool, i);
+            return -1;
+        }
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_submitted, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+    for (; pool->thread_number < thread_number; ++pool->thread_number) {
+        if (pthread_create(&pool->threads[pool->thread_number], NULL, transform_jobs, pool)) break;
+    }
+    if (!pool->thread_number) {
+        pool_stop(pool);
+        return -1;
+    }
+    return 0;
+}
+
+int pool_in_flight(struct transform_pool* pool) {
+    // only the caller changes the number of submitted jobs
+    return pool->submitted;
+}
+
+void pool_submit(struct transform_pool* pool, const char* input, size_t input_size, int tag) {
+    pthread_mutex_lock(&pool->lock);
+    struct transform_job* job = &pool->jobs[(pool->first + pool->submitted++) % pool->job_number];
+    job->input = input;
+    job->input_size = input_size;
+    job->done = 0;
+    job->tag = tag;
+    pthread_cond_signal(&pool->job_submitted);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+struct transform_job* pool_oldest(struct transform_pool* pool) {
+    struct transform_job* job = &pool->jobs[pool->first];
+    pthread_mutex_lock(&pool->lock);
+    while (!job->done) pthread_cond_wait(&pool->job_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    return job;
+}
+
+void pool_release(struct transform_pool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->first = (pool->first + 1) % pool->job_number;
+    --pool->submitted;
+    --pool->taken;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_discard(struct transform_pool* pool) {
+    while (pool_in_flight(pool)) {
+        pool_oldest(pool);
+        pool_release(pool);
+    }
+}
+
+void pool_stop(struct transform_pool* pool) {
+    pool_discard(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->stopped = 1;
+    pthread_cond_broadcast(&pool->job_submitted);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_number; ++i) pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->job_submitted);
+    pthread_cond_destroy(&pool->job_done);
+    free_jobs(pool, pool->job_number);
+}
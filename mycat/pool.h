@@ -0,0 +1,52 @@
+#ifndef MYCAT_POOL_H
+#define MYCAT_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "escape.h"
+
+// Transforms the submitted buffers on several threads, the results are taken in the order of submission.
+// The input of a job must stay valid until the job is released.
+struct transform_job {
+    const char* input;
+    size_t input_size;
+    char* output;
+    size_t output_size;
+    int done;
+    // set by the caller, returned with the result
+    int tag;
+};
+
+struct transform_pool {
+    escape_function transform;
+    pthread_t* threads;
+    int thread_number;
+
+    // a ring of jobs, the first is the oldest, the workers take them in order
+    struct transform_job* jobs;
+    int job_number;
+    int first;
+    int submitted;
+    int taken;
+    int stopped;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_submitted;
+    pthread_cond_t job_done;
+};
+
+// Every job has an output buffer for 4 * max_input bytes. Returns 0 on success
+int pool_start(struct transform_pool* pool, int thread_number, int job_number, size_t max_input,
+               escape_function transform);
+// Number of jobs submitted and not released yet
+int pool_in_flight(struct transform_pool* pool);
+// The caller makes sure that there is a free job
+void pool_submit(struct transform_pool* pool, const char* input, size_t input_size, int tag);
+// Waits until the oldest job is transformed
+struct transform_job* pool_oldest(struct transform_pool* pool);
+void pool_release(struct transform_pool* pool);
+// Waits for all the jobs and releases them without looking at the results
+void pool_discard(struct transform_pool* pool);
+void pool_stop(struct transform_pool* pool);
+
+#endif //MYCAT_POOL_H
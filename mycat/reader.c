@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include "reader.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+int open_input(const char* filename, int prefetch) {
+    int file;
+    while ((file = open(filename, O_RDONLY | O_CLOEXEC)) < 0 && errno == EINTR);
+    if (file < 0) return -1;
+
+    posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (prefetch) posix_fadvise(file, 0, 0, POSIX_FADV_WILLNEED);
+    return file;
+}
+
+static ssize_t read_full(int file, char* buffer, size_t buffer_size) {
+    size_t total_number_read = 0;
+
+    while (total_number_read < buffer_size) {
+        ssize_t number_read = read(file, &buffer[total_number_read], buffer_size - total_number_read);
+        if (number_read < 0) {
+            if (errno != EINTR) return -1;
+        } else if (!number_read) {
+            break;
+        } else {
+            total_number_read += number_read;
+        }
+    }
+
+    return total_number_read;
+}
+
+// Waits for a free chunk, NULL if the reader is stopped
+static struct reader_chunk* acquire_chunk(struct reader* reader) {
+    pthread_mutex_lock(&reader->lock);
+    while (reader->filled == reader->chunk_number && !reader->stopped)
+        pthread_cond_wait(&reader->chunk_released, &reader->lock);
+    struct reader_chunk* chunk = reader->stopped ? NULL :
+            &reader->chunks[(reader->first_filled + reader->filled) % reader->chunk_number];
+    pthread_mutex_unlock(&reader->lock);
+    return chunk;
+}
+
+static void publish_chunk(struct reader* reader) {
+    pthread_mutex_lock(&reader->lock);
+    ++reader->filled;
+    pthread_cond_signal(&reader->chunk_filled);
+    pthread_mutex_unlock(&reader->lock);
+}
+
+static void* read_files(void* argument) {
+    struct reader* reader = argument;
+    int next_file = reader->filenum ? open_input(reader->filenames[0], 1) : -1;
+
+    for (int i = 0; i < reader->filenum; ++i) {
+        int file = next_file;
+        next_file = i + 1 < reader->filenum ? open_input(reader->filenames[i + 1], 1) : -1;
+
+        struct reader_chunk* chunk;
+        if (file < 0) {
+            if (!(chunk = acquire_chunk(reader))) break;
+            chunk->file_index = i;
+            chunk->status = READER_OPEN_ERROR;
+            publish_chunk(reader);
+            break;
+        }
+
+        struct stat file_stat;
+        if (reader->map_threshold && !fstat(file, &file_stat) && file_stat.st_size >= reader->map_threshold) {
+            if (!(chunk = acquire_chunk(reader))) {
+                close(file);
+                break;
+            }
+            chunk->file_index = i;
+            chunk->status = READER_MAPPED;
+            chunk->file = file;
+            chunk->file_size = file_stat.st_size;
+            publish_chunk(reader);
+        } else {
+            ssize_t number_read;
+            do {
+                if (!(chunk = acquire_chunk(reader))) break;
+                // the buffers are allocated when they are first read into, mapped files don't need them
+                if (!chunk->data) chunk->data = malloc(reader->buffer_size);
+                number_read = chunk->data ? read_full(file, chunk->data, reader->buffer_size) : -1;
+                chunk->file_index = i;
+                chunk->status = number_read < 0 ? READER_READ_ERROR : READER_DATA;
+                chunk->size = number_read < 0 ? 0 : number_read;
+                publish_chunk(reader);
+            } while (number_read > 0);
+            close(file);
+        }
+
+        if (!chunk || chunk->status == READER_READ_ERROR) {
+            chunk = NULL;
+            break;
+        }
+        if (i + 1 == reader->filenum && (chunk = acquire_chunk(reader))) {
+            chunk->file_index = i;
+            chunk->status = READER_END;
+            publish_chunk(reader);
+        }
+    }
+
+    if (next_file >= 0) close(next_file);
+    return NULL;
+}
+
+int reader_start(struct reader* reader, char** filenames, int filenum, size_t buffer_size, int chunk_number,
+                 off_t map_threshold) {
+    reader->filenames = filenames;
+    reader->filenum = filenum;
+    reader->buffer_size = buffer_size;
+    reader->map_threshold = map_threshold;
+    reader->chunk_number = chunk_number;
+    reader->first_filled = 0;
+    reader->filled = 0;
+    reader->stopped = 0;
+    reader->thread_started = 0;
+
+    reader->chunks = calloc(chunk_number, sizeof(struct reader_chunk));
+    if (!reader->chunks) return -1;
+
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->chunk_filled, NULL);
+    pthread_cond_init(&reader->chunk_released, NULL);
+    if (pthread_create(&reader->thread, NULL, read_files, reader)) {
+        reader_stop(reader);
+        return -1;
+    }
+    reader->thread_started = 1;
+    return 0;
+}
+
+struct reader_chunk* reader_next(struct reader* reader) {
+    return reader_peek(reader, 0);
+}
+
+struct reader_chunk* reader_peek(struct reader* reader, int n) {
+    pthread_mutex_lock(&reader->lock);
+    while (reader->filled <= n) pthread_cond_wait(&reader->chunk_filled, &reader->lock);
+    struct reader_chunk* chunk = &reader->chunks[(reader->first_filled + n) % reader->chunk_number];
+    pthread_mutex_unlock(&reader->lock);
+    return chunk;
+}
+
+void reader_release(struct reader* reader) {
+    pthread_mutex_lock(&reader->lock);
+    reader->first_filled = (reader->first_filled + 1) % reader->chunk_number;
+    --reader->filled;
+    pthread_cond_signal(&reader->chunk_released);
+    pthread_mutex_unlock(&reader->lock);
+}
+
+void reader_stop(struct reader* reader) {
+    pthread_mutex_lock(&reader->lock);
+    reader->stopped = 1;
+    pthread_cond_signal(&reader->chunk_released);
+    pthread_mutex_unlock(&reader->lock);
+    if (reader->thread_started) pthread_join(reader->thread, NULL);
+
+    // the files that were not given to the caller
+    for (int i = 0; i < reader->filled; ++i) {
+        struct reader_chunk* chunk = &reader->chunks[(reader->first_filled + i) % reader->chunk_number];
+        if (chunk->status == READER_MAPPED && chunk->file >= 0) close(chunk->file);
+    }
+
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->chunk_filled);
+    pthread_cond_destroy(&reader->chunk_released);
+    for (int i = 0; i < reader->chunk_number; ++i) free(reader->chunks[i].data);
+    free(reader->chunks);
+}
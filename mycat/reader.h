@@ -0,0 +1,60 @@
+#ifndef MYCAT_READER_H
+#define MYCAT_READER_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// Opens the file for a sequential read, with prefetch the kernel starts reading it ahead
+// Returns -1 if the file cannot be opened
+int open_input(const char* filename, int prefetch);
+
+// Reads the files one after another on a separate thread into a ring of buffers,
+// so that the next reads are in flight while the caller writes the previous buffer.
+// The files are opened only when they are reached, the next one is prefetched.
+// The files of at least map_threshold bytes are not read, the caller gets their descriptor to map them.
+// The buffers are allocated when they are first read into, so mapped files take none.
+enum reader_status { READER_DATA, READER_MAPPED, READER_END, READER_OPEN_ERROR, READER_READ_ERROR };
+
+struct reader_chunk {
+    char* data;
+    size_t size;
+    int file_index;
+    enum reader_status status;
+    // READER_MAPPED only, the caller closes the file and sets it to -1
+    int file;
+    off_t file_size;
+};
+
+struct reader {
+    char** filenames;
+    int filenum;
+    size_t buffer_size;
+    off_t map_threshold;
+
+    struct reader_chunk* chunks;
+    int chunk_number;
+    int first_filled;
+    int filled;
+    int stopped;
+
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_filled;
+    pthread_cond_t chunk_released;
+    pthread_t thread;
+    int thread_started;
+};
+
+// Returns 0 on success, map_threshold 0 turns mapping off
+int reader_start(struct reader* reader, char** filenames, int filenum, size_t buffer_size, int chunk_number,
+                 off_t map_threshold);
+// Waits for the next chunk, the status of the last one is READER_END or an error
+struct reader_chunk* reader_next(struct reader* reader);
+// Waits for the chunk that follows n chunks not released yet
+struct reader_chunk* reader_peek(struct reader* reader, int n);
+// The chunk from reader_next can be reused for reading
+void reader_release(struct reader* reader);
+// Stops the reading if it is not finished yet and frees the buffers
+void reader_stop(struct reader* reader);
+
+#endif //MYCAT_READER_H
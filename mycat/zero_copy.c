@@ -0,0 +1,64 @@
+#define _GNU_SOURCE
+#include "zero_copy.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+// The kernel copies at most this much in one call anyway
+static const size_t chunk_size = 0x7ffff000;
+
+enum copy_method { COPY_NONE, COPY_FILE_RANGE, COPY_SPLICE, COPY_SENDFILE };
+
+static enum copy_method choose_method(int file_out) {
+    struct stat out_stat;
+    if (fstat(file_out, &out_stat) < 0) return COPY_NONE;
+
+    if (S_ISREG(out_stat.st_mode)) {
+        // copy_file_range refuses the files opened for appending
+        int flags = fcntl(file_out, F_GETFL);
+        return flags >= 0 && !(flags & O_APPEND) ? COPY_FILE_RANGE : COPY_NONE;
+    }
+    if (S_ISFIFO(out_stat.st_mode)) return COPY_SPLICE;
+    if (S_ISSOCK(out_stat.st_mode)) return COPY_SENDFILE;
+    return COPY_NONE;
+}
+
+// The errors after which the buffered loop still can do the job
+static int is_unsupported(int error) {
+    return error == ENOSYS || error == EINVAL || error == EXDEV || error == EOPNOTSUPP || error == EBADF;
+}
+
+static int is_write_error(int error) {
+    return error == EPIPE || error == ENOSPC || error == EDQUOT || error == EFBIG;
+}
+
+int zero_copy_supported(int file_out) {
+    return choose_method(file_out) != COPY_NONE;
+}
+
+int zero_copy_file(int file_in, int file_out) {
+    enum copy_method method = choose_method(file_out);
+    if (method == COPY_NONE) return 1;
+
+    for (;;) {
+        ssize_t number_copied;
+        if (method == COPY_FILE_RANGE) {
+            number_copied = copy_file_range(file_in, NULL, file_out, NULL, chunk_size, 0);
+        } else if (method == COPY_SPLICE) {
+            number_copied = splice(file_in, NULL, file_out, NULL, chunk_size, SPLICE_F_MOVE | SPLICE_F_MORE);
+        } else {
+            number_copied = sendfile(file_out, file_in, NULL, chunk_size);
+        }
+
+        if (number_copied < 0) {
+            if (errno == EINTR) continue;
+            // the offsets were moved by what was already copied
+            if (is_unsupported(errno)) return 1;
+            return is_write_error(errno) ? -2 : -1;
+        }
+        if (!number_copied) return 0;
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef MYCAT_ZERO_COPY_H
+#define MYCAT_ZERO_COPY_H
+
+// Copies the rest of file_in to file_out inside the kernel:
+// copy_file_range for a regular file, splice for a pipe and sendfile for a socket.
+// Returns 0 when the whole file is copied, 1 if the caller should continue with read/write
+// from the current offset, -1 on a read error and -2 on a write error
+int zero_copy_file(int file_in, int file_out);
+// False if zero_copy_file would never copy to file_out
+int zero_copy_supported(int file_out);
+
+#endif //MYCAT_ZERO_COPY_H
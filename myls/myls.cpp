@@ -1,10 +1,13 @@
-#include <iostream>
-
 #include <boost/filesystem.hpp>
 #include <boost/date_time.hpp>
 #include <sys/stat.h>
 #include <errno.h>
 #include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include "filef.h"
 
 #define fs boost::filesystem
 
@@ -15,6 +18,27 @@ struct FileInfo {
     char fileType; // *@|=/?
 };
 
+struct Config {
+    bool detailed_info = false;
+    bool showFileTypes = false;
+
+    char sortBy = 'U';
+    bool directoriesFirst = false;
+    bool specialFilesSeparately = false;
+    bool reversed = false;
+
+    bool recurse = false;
+};
+
+char fileTypeOf(mode_t mode) {
+    if (S_ISDIR(mode)) return '/';
+    else if (S_ISLNK(mode)) return '@';
+    else if (S_ISSOCK(mode)) return '=';
+    else if (S_ISFIFO(mode)) return '|';
+    else if (S_IXGRP & mode || S_IXUSR & mode) return '*';
+    else return '?';
+}
+
 FileInfo getFileInfo(std::string path) {
     struct stat fileStat;
 
@@ -32,13 +56,7 @@ FileInfo getFileInfo(std::string path) {
     }
 
     FileInfo fileInfo;
-
-    if (S_ISDIR(fileStat.st_mode)) fileInfo.fileType = '/';
-    else if (S_ISLNK(fileStat.st_mode)) fileInfo.fileType = '@';
-    else if (S_ISSOCK(fileStat.st_mode)) fileInfo.fileType = '=';
-    else if (S_ISFIFO(fileStat.st_mode)) fileInfo.fileType = '|';
-    else if (S_IXGRP & fileStat.st_mode || S_IXUSR & fileStat.st_mode) fileInfo.fileType = '*';
-    else fileInfo.fileType = '?';
+    fileInfo.fileType = fileTypeOf(fileStat.st_mode);
 
     // remove last slash
     if (path[path.size() - 1] == '/') path = path.substr(0, path.size() - 1);
@@ -50,31 +68,81 @@ FileInfo getFileInfo(std::string path) {
     return fileInfo;
 }
 
-std::vector<std::string> listDirectory(fs::path path) {
-    fs::directory_iterator iterator{path};
-    fs::directory_iterator end;
-    std::vector<std::string> result;
+// The statx fields the options need besides the type from the directory entry
+unsigned neededFields(const Config& config) {
+    unsigned fields = 0;
+    // executables are only marked with -F
+    if (config.showFileTypes) fields |= STATX_TYPE | STATX_MODE;
+    if (config.detailed_info || config.sortBy == 'S') fields |= STATX_SIZE;
+    if (config.detailed_info || config.sortBy == 't') fields |= STATX_MTIME;
+    return fields;
+}
 
-    while (iterator != end) {
-        fs::directory_entry entry = *iterator;
-        result.push_back(entry.path().string());
-        ++iterator;
+// 0 if the type is unknown and the entry has to be stat'ed
+char fileTypeOfEntry(unsigned char type) {
+    switch (type) {
+        case DT_DIR: return '/';
+        case DT_LNK: return '@';
+        case DT_SOCK: return '=';
+        case DT_FIFO: return '|';
+        case DT_REG: case DT_CHR: case DT_BLK: return '?';
+        default: return 0;
     }
-
-    return result;
 }
 
-struct Config {
-    bool detailed_info = false;
-    bool showFileTypes = false;
+// Reads the entries with getdents64 from a directory descriptor, an entry is only stat'ed
+// relative to it when the options need more than its type
+void listDirectory(const Config& config, const fs::path& path, std::vector<FileInfo>& infos) {
+    int directory;
+    while ((directory = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 && errno == EINTR);
+    if (directory < 0) throw std::runtime_error("Error listing directory " + path.string() + ".");
 
-    char sortBy = 'U';
-    bool directoriesFirst = false;
-    bool specialFilesSeparately = false;
-    bool reversed = false;
+    // like getFileInfo, "d/" is "d" and not "d/."
+    std::string prefix = path.lexically_normal().string();
+    if (prefix.length() > 2 && prefix.compare(prefix.length() - 2, 2, "/.") == 0) prefix.pop_back();
+    if (prefix[prefix.length() - 1] != '/') prefix += '/';
+    unsigned fields = neededFields(config);
 
-    bool recurse = false;
-};
+    alignas(struct dirent64) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = getdents64(directory, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) continue;
+        if (length < 0) {
+            close(directory);
+            throw std::runtime_error("Error listing directory " + path.string() + ".");
+        }
+        if (length == 0) break;
+
+        for (ssize_t position = 0; position < length;) {
+            auto* entry = reinterpret_cast<struct dirent64*>(buffer + position);
+            position += entry->d_reclen;
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            FileInfo info;
+            info.path = fs::path{prefix + name};
+            info.fileType = fileTypeOfEntry(entry->d_type);
+            info.size = 0;
+            info.modification_time = 0;
+
+            unsigned entryFields = info.fileType ? fields : fields | STATX_TYPE | STATX_MODE;
+            if (entryFields) {
+                struct statx entryStat;
+                if (statx(directory, name, AT_SYMLINK_NOFOLLOW, entryFields, &entryStat) != 0) {
+                    // removed after it was listed
+                    if (errno == ENOENT) continue;
+                    close(directory);
+                    throw std::runtime_error("Error getting info of file " + info.path.string() + ".");
+                }
+                if (entryFields & STATX_MODE) info.fileType = fileTypeOf(entryStat.stx_mode);
+                info.size = entryStat.stx_size;
+                info.modification_time = entryStat.stx_mtime.tv_sec;
+            }
+            infos.push_back(std::move(info));
+        }
+    }
+    close(directory);
+}
 
 inline bool isSpecialFile(FileInfo& info) {
     static std::string specialFiles = "@|=";
@@ -85,8 +153,7 @@ void appendInfosForFile(Config& config, fs::path path, std::vector<FileInfo>& in
     FileInfo info = getFileInfo(path.string());
 
     if (info.fileType == '/') {
-        std::vector<std::string> paths = listDirectory(path);
-        for (auto &path: paths) infos.push_back(getFileInfo(path));
+        listDirectory(config, path, infos);
 
         if (config.sortBy != 'U') {
             std::sort(infos.begin(), infos.end(), [&config](FileInfo &a, FileInfo &b) {
@@ -115,6 +182,10 @@ void appendInfosForFile(Config& config, fs::path path, std::vector<FileInfo>& in
     }
 }
 
+// The listing is collected and written in large pieces
+static char outputStorage[64 * 1024];
+static filef_buffer output;
+
 void showInfo(Config& config, std::vector<std::string> paths) {
     if (paths.empty()) paths.emplace_back(".");
 
@@ -122,29 +193,23 @@ void showInfo(Config& config, std::vector<std::string> paths) {
     for (auto& path: paths) appendInfosForFile(config, path, infos);
 
     for (auto& info: infos) {
-        std::cout << (config.showFileTypes || info.fileType == '/' ? info.fileType : ' ');
+        bfilef(&output, "%c", config.showFileTypes || info.fileType == '/' ? info.fileType : ' ');
 
         std::string name = info.path.filename().string();
         if (config.detailed_info) {
             boost::posix_time::ptime date = boost::posix_time::from_time_t(info.modification_time);
-
-            std::ios initialConfig(nullptr);
-            initialConfig.copyfmt(std::cout);
-            std::cout << std::setw(30) << std::left << name
-                      << std::setw(14) << info.size
-                      << std::setw(14) << date;
-            std::cout << std::endl;
-            std::cout.copyfmt(initialConfig);
+            bfilef(&output, "%-30s%-14d%-14s\n", name.c_str(), info.size,
+                   boost::posix_time::to_simple_string(date).c_str());
         } else {
-            std::cout << name << " ";
+            bfilef(&output, "%s ", name.c_str());
         }
     }
-    if (!infos.empty()) std::cout << std::endl;
+    if (!infos.empty()) bfilef(&output, "\n");
 
     // recurse over other directories
     for (auto& info: infos) {
         if (config.recurse && info.fileType == '/') {
-            std::cout << std::endl << info.path.string() << ":" << std::endl;
+            bfilef(&output, "\n%s:\n", info.path.string().c_str());
             showInfo(config, {info.path.string()});
         }
     }
@@ -188,7 +253,7 @@ int main(int argc, char** argv) {
                 } else if (c == 's') {
                     config.specialFilesSeparately = true;
                 } else {
-                    std::cerr << "Invalid value for sorting: " << c << std::endl;
+                    filef(STDERR_FILENO, "Invalid value for sorting: %c\n", c);
                     return 2;
                 }
             }
@@ -209,17 +274,20 @@ int main(int argc, char** argv) {
 
     for (auto &path: paths) {
         if (!fs::exists(path)) {
-            std::cerr << "File doesn't exist: " << path << std::endl;
+            filef(STDERR_FILENO, "File doesn't exist: %s\n", path.c_str());
             return 1;
         }
     }
 
+    filef_buffer_init(&output, STDOUT_FILENO, outputStorage, sizeof(outputStorage));
     try {
         showInfo(config, paths);
     } catch (std::exception& e) {
-        std::cerr << e.what() << std::endl;
+        filef_flush(&output);
+        filef(STDERR_FILENO, "%s\n", e.what());
         return 3;
     }
+    filef_flush(&output);
 
     return 0;
 }
\ No newline at end of file
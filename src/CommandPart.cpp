@@ -76,11 +76,107 @@ std::vector<CommandPart> CommandPart::splitCommand(char separator) {
     std::vector<CommandPart> result;
     size_t startI = 0;
     char quotes = 0;
+    size_t depth = 0;
+    bool inParameter = false;
+    size_t arithmeticDepth = 0;
+
+    // a word that is a single ${...} is marked with the '{' quotes and a single $((...)) with the '$' quotes
+    // like a command substitution, otherwise they are expanded within the word
+    auto addWord = [&](size_t end) {
+        if (end - startI == 0) return;
+        CommandPart word = subPart(startI, end);
+        size_t last = end - startI - 1;
+        if (word.size() >= 3 && word.string.compare(0, 2, "${") == 0 && word.string.find('}') == last &&
+            !word.escaped[0] && !word.escaped[1] && !word.escaped[last])
+        {
+            word = subPart(startI + 2, end - 1);
+            word.quotes = '{';
+        } else if (word.size() >= 5 && word.string.compare(0, 3, "$((") == 0 && !word.escaped[0] &&
+                   !word.escaped[1] && !word.escaped[2])
+        {
+            size_t wordDepth = 0, close = 1;
+            for (; close < word.size(); ++close) {
+                if (word.escaped[close]) continue;
+                if (word[close] == '(') ++wordDepth;
+                else if (word[close] == ')' && --wordDepth == 0) break;
+            }
+            if (close == last) {
+                word = subPart(startI + 2, end - 1);
+                word.quotes = '$';
+            }
+        }
+        result.push_back(word);
+    };
 
     for (size_t i = 0; i <= string.length(); ++i) {
         if (i != string.length() && escaped[i]) continue;
+        // parameter expansion ${...} and arithmetic expansion $((...)), may contain separators
+        if (inParameter) {
+            if (i != string.length()) {
+                if (string[i] == '}') inParameter = false;
+                continue;
+            }
+        } else if (arithmeticDepth > 0) {
+            if (i != string.length()) {
+                if (string[i] == '(') ++arithmeticDepth;
+                else if (string[i] == ')') --arithmeticDepth;
+                continue;
+            }
+        } else if (i != string.length() && quotes == 0 && string[i] == '$' && i + 1 < string.length() &&
+            string[i + 1] == '{' && !escaped[i + 1])
+        {
+            inParameter = true;
+            ++i;
+            continue;
+        } else if (i != string.length() && quotes == 0 && string[i] == '$' && i + 2 < string.length() &&
+            string[i + 1] == '(' && string[i + 2] == '(' && !escaped[i + 1] && !escaped[i + 2])
+        {
+            arithmeticDepth = 2;
+            i += 2;
+            continue;
+        }
+        if (i != string.length() && quotes == '$' && i >= startI) {
+            // parentheses nested in command substitution
+            if (string[i] == '(') ++depth;
+            else if (string[i] == ')' && depth > 0) {
+                --depth;
+                continue;
+            }
+        }
+        // group in parentheses or process substitution, may contain other parentheses
+        bool group = quotes == '(' || quotes == '<' || quotes == '>';
+        if (i != string.length() && quotes == 0 && i == startI && (string[i] == '<' || string[i] == '>') &&
+            i + 1 < string.length() && string[i + 1] == '(' && !escaped[i + 1])
+        {
+            quotes = string[i];
+            startI = i + 2;
+            depth = 1;
+            ++i;
+            continue;
+        }
+        // a group only starts a word, "a(b)c" stays a single word
+        if (i != string.length() && (group || (quotes == 0 && i == startI)) && string[i] == '(') {
+            if (quotes == 0) {
+                addWord(i);
+                quotes = '(';
+                startI = i + 1;
+            }
+            ++depth;
+            continue;
+        }
+        if (group) {
+            if (i != string.length() && string[i] == ')' && --depth == 0) {
+                CommandPart sub = subPart(startI, i);
+                sub.quotes = quotes;
+                result.push_back(sub);
+                quotes = 0;
+                startI = i + 1;
+            }
+            continue;
+        }
         if (i == string.length() || (!quotes && string[i] == separator)) {
-            if (i - startI > 0) result.push_back(subPart(startI, i));
+            if (quotes == 0) addWord(i);
+            else if (i - startI > 0) result.push_back(subPart(startI, i));
             startI = i + 1;
         } else if (string[i] == '"' || string[i] == '\'' ||
             (string[i] == '$' && i < string.length() && string[i+1] == '(') ||
@@ -96,7 +192,7 @@ std::vector<CommandPart> CommandPart::splitCommand(char separator) {
                 quotes = 0;
                 startI = i + 1;
             } else if (quotes == 0) {
-                if (i - startI > 0) result.push_back(subPart(startI, i));
+                addWord(i);
                 quotes = string[i];
                 startI = i + (quotes == '$' ? 2 : 1);
             }
@@ -0,0 +1,57 @@
+#include "argumentBatch.h"
+
+#include <stdexcept>
+#include <limits>
+#include <unistd.h>
+
+const size_t ArgumentBatch::NO_LIMIT = std::numeric_limits<size_t>::max();
+
+// Same headroom as POSIX asks from xargs
+static const size_t ARGUMENT_HEADROOM = 2048;
+// The kernel also limits every single string to 32 pages
+static const size_t PAGES_PER_ARGUMENT = 32;
+
+size_t ArgumentBatch::argumentSize(const std::string& argument) {
+    return argument.length() + 1 + sizeof(char*);
+}
+
+size_t ArgumentBatch::systemLimit(const std::unordered_map<std::string, std::string>& environment) {
+    long argMax = sysconf(_SC_ARG_MAX);
+    size_t limit = argMax > 0 ? (size_t) argMax : 128 * 1024;
+
+    // the terminating null pointers of argv and envp
+    size_t used = ARGUMENT_HEADROOM + 2 * sizeof(char*);
+    for (auto& variable: environment) used += argumentSize(variable.first + "=" + variable.second);
+    if (used >= limit) throw std::runtime_error("The environment leaves no space for arguments");
+    return limit - used;
+}
+
+ArgumentBatch::ArgumentBatch(std::vector<std::string> fixed, size_t limit, size_t maxArguments):
+        fixed(std::move(fixed)), limit(limit), maxArguments(maxArguments) {
+    for (auto& argument: this->fixed) fixedSize += argumentSize(argument);
+    if (fixedSize >= limit) throw std::invalid_argument("The command is too long");
+}
+
+bool ArgumentBatch::fits(const std::string& argument) const {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (argument.length() + 1 > (pageSize > 0 ? (size_t) pageSize : 4096) * PAGES_PER_ARGUMENT ||
+        fixedSize + argumentSize(argument) > limit) {
+        throw std::invalid_argument("Argument too long: " + argument.substr(0, 64));
+    }
+    return arguments.size() < maxArguments && fixedSize + size + argumentSize(argument) <= limit;
+}
+
+void ArgumentBatch::add(const std::string& argument) {
+    size += argumentSize(argument);
+    arguments.push_back(argument);
+}
+
+std::vector<std::string> ArgumentBatch::take() {
+    std::vector<std::string> commandLine;
+    commandLine.reserve(fixed.size() + arguments.size());
+    commandLine.insert(commandLine.end(), fixed.begin(), fixed.end());
+    commandLine.insert(commandLine.end(), arguments.begin(), arguments.end());
+    arguments.clear();
+    size = 0;
+    return commandLine;
+}
@@ -0,0 +1,195 @@
+#include "arithmetic.h"
+
+#include <cctype>
+#include <stdexcept>
+
+// Binary operators from the lowest precedence to the highest
+static const std::vector<std::vector<std::string>> BINARY_OPERATORS = {
+        {"||"}, {"&&"}, {"|"}, {"^"}, {"&"}, {"==", "!="}, {"<", "<=", ">", ">="},
+        {"<<", ">>"}, {"+", "-"}, {"*", "/", "%"}, {"**"}
+};
+
+static int64_t parseInteger(const std::string& string, const std::string& name) {
+    if (string.empty()) return 0;
+    size_t end = 0;
+    int64_t result;
+    try {
+        result = std::stoll(string, &end, 0);
+    } catch (...) {
+        end = 0;
+    }
+    if (end != string.length())
+        throw std::invalid_argument("Invalid number in arithmetic expansion: " + (name.empty() ? string : name + "=" + string));
+    return result;
+}
+
+ArithmeticExpression::ArithmeticExpression(const std::string& expression) {
+    tokenize(expression);
+    if (tokens.empty()) {
+        root = add(Node{NUMBER, "", 0, "", -1, -1, -1});
+    } else {
+        root = parseTernary();
+        if (position != tokens.size())
+            throw std::invalid_argument("Unexpected token in arithmetic expansion: " + tokens[position]);
+    }
+    tokens.clear();
+}
+
+void ArithmeticExpression::tokenize(const std::string& expression) {
+    static const std::string twoCharOperators[] = {"||", "&&", "==", "!=", "<=", ">=", "<<", ">>", "**"};
+
+    size_t i = 0;
+    while (i < expression.length()) {
+        char c = expression[i];
+        if (std::isspace((unsigned char) c)) {
+            ++i;
+        } else if (std::isalnum((unsigned char) c) || c == '_' || c == '$') {
+            size_t start = c == '$' ? i + 1 : i;
+            size_t end = start;
+            while (end < expression.length() && (std::isalnum((unsigned char) expression[end]) || expression[end] == '_')) ++end;
+            if (end == start) throw std::invalid_argument("Invalid variable in arithmetic expansion");
+            tokens.push_back(expression.substr(start, end - start));
+            i = end;
+        } else {
+            std::string two = expression.substr(i, 2);
+            bool found = false;
+            for (auto& op: twoCharOperators) found = found || two == op;
+            if (found) {
+                tokens.push_back(two);
+                i += 2;
+            } else if (std::string("+-*/%<>&|^!~?:()").find(c) != std::string::npos) {
+                tokens.emplace_back(1, c);
+                ++i;
+            } else {
+                throw std::invalid_argument(std::string("Invalid character in arithmetic expansion: ") + c);
+            }
+        }
+    }
+}
+
+int ArithmeticExpression::add(Node node) {
+    nodes.push_back(node);
+    return (int) nodes.size() - 1;
+}
+
+int ArithmeticExpression::parseTernary() {
+    int condition = parseBinary(0);
+    if (position < tokens.size() && tokens[position] == "?") {
+        ++position;
+        int whenTrue = parseTernary();
+        if (position >= tokens.size() || tokens[position] != ":")
+            throw std::invalid_argument("Expected : in arithmetic expansion");
+        ++position;
+        int whenFalse = parseTernary();
+        return add(Node{TERNARY, "?", 0, "", condition, whenTrue, whenFalse});
+    }
+    return condition;
+}
+
+int ArithmeticExpression::parseBinary(int precedence) {
+    if (precedence == (int) BINARY_OPERATORS.size()) return parseUnary();
+
+    int left = parseBinary(precedence + 1);
+    while (position < tokens.size()) {
+        bool found = false;
+        for (auto& op: BINARY_OPERATORS[precedence]) found = found || tokens[position] == op;
+        if (!found) break;
+
+        std::string op = tokens[position++];
+        // ** is right associative
+        int right = op == "**" ? parseBinary(precedence) : parseBinary(precedence + 1);
+        left = add(Node{BINARY, op, 0, "", left, right, -1});
+        if (op == "**") break;
+    }
+    return left;
+}
+
+int ArithmeticExpression::parseUnary() {
+    if (position < tokens.size()) {
+        const std::string& op = tokens[position];
+        if (op == "-" || op == "+" || op == "!" || op == "~") {
+            ++position;
+            std::string unaryOp = op;
+            int operand = parseUnary();
+            return add(Node{UNARY, unaryOp, 0, "", operand, -1, -1});
+        }
+    }
+    return parsePrimary();
+}
+
+int ArithmeticExpression::parsePrimary() {
+    if (position >= tokens.size()) throw std::invalid_argument("Unexpected end of arithmetic expansion");
+
+    std::string token = tokens[position++];
+    if (token == "(") {
+        int inner = parseTernary();
+        if (position >= tokens.size() || tokens[position] != ")")
+            throw std::invalid_argument("Expected ) in arithmetic expansion");
+        ++position;
+        return inner;
+    }
+    if (std::isdigit((unsigned char) token[0])) return add(Node{NUMBER, "", parseInteger(token, ""), "", -1, -1, -1});
+    if (std::isalpha((unsigned char) token[0]) || token[0] == '_') return add(Node{VARIABLE, "", 0, token, -1, -1, -1});
+    throw std::invalid_argument("Unexpected token in arithmetic expansion: " + token);
+}
+
+int64_t ArithmeticExpression::evaluate(const lookup_t& lookup) const {
+    return evaluate(root, lookup);
+}
+
+int64_t ArithmeticExpression::evaluate(int index, const lookup_t& lookup) const {
+    const Node& node = nodes[index];
+    switch (node.kind) {
+        case NUMBER:
+            return node.value;
+        case VARIABLE:
+            return parseInteger(lookup(node.name), node.name);
+        case TERNARY:
+            return evaluate(node.left, lookup) ? evaluate(node.right, lookup) : evaluate(node.third, lookup);
+        case UNARY: {
+            int64_t operand = evaluate(node.left, lookup);
+            if (node.op == "-") return (int64_t) (0 - (uint64_t) operand);
+            if (node.op == "!") return !operand;
+            if (node.op == "~") return ~operand;
+            return operand;
+        }
+        case BINARY:
+            break;
+    }
+
+    const std::string& op = node.op;
+    int64_t left = evaluate(node.left, lookup);
+    // short-circuit
+    if (op == "&&") return left && evaluate(node.right, lookup);
+    if (op == "||") return left || evaluate(node.right, lookup);
+
+    int64_t right = evaluate(node.right, lookup);
+    // wrap on overflow instead of undefined behaviour
+    if (op == "+") return (int64_t) ((uint64_t) left + (uint64_t) right);
+    if (op == "-") return (int64_t) ((uint64_t) left - (uint64_t) right);
+    if (op == "*") return (int64_t) ((uint64_t) left * (uint64_t) right);
+    if (op == "/" || op == "%") {
+        if (right == 0) throw std::invalid_argument("Division by zero in arithmetic expansion");
+        if (right == -1) return op == "/" ? (int64_t) (0 - (uint64_t) left) : 0;
+        return op == "/" ? left / right : left % right;
+    }
+    if (op == "**") {
+        if (right < 0) throw std::invalid_argument("Negative exponent in arithmetic expansion");
+        uint64_t result = 1, base = (uint64_t) left;
+        for (; right; right >>= 1, base *= base) {
+            if (right & 1) result *= base;
+        }
+        return (int64_t) result;
+    }
+    if (op == "<<") return (int64_t) ((uint64_t) left << (right & 63));
+    if (op == ">>") return left >> (right & 63);
+    if (op == "<") return left < right;
+    if (op == "<=") return left <= right;
+    if (op == ">") return left > right;
+    if (op == ">=") return left >= right;
+    if (op == "==") return left == right;
+    if (op == "!=") return left != right;
+    if (op == "&") return left & right;
+    if (op == "^") return left ^ right;
+    return left | right;
+}
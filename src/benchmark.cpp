@@ -0,0 +1,94 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+// Each power of two is split into this number of buckets, like in HDR histograms
+static const int SUB_BUCKETS = 4;
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t) std::ceil(fraction * sorted.size());
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+static int bucketOf(double microseconds) {
+    if (microseconds < 1) return 0;
+    int exponent = (int) std::floor(std::log2(microseconds));
+    double fraction = microseconds / std::ldexp(1.0, exponent) - 1;
+    return 1 + exponent * SUB_BUCKETS + std::min((int) (fraction * SUB_BUCKETS), SUB_BUCKETS - 1);
+}
+
+static double bucketStart(int bucket) {
+    if (bucket == 0) return 0;
+    int exponent = (bucket - 1) / SUB_BUCKETS;
+    int subBucket = (bucket - 1) % SUB_BUCKETS;
+    return std::ldexp(1.0, exponent) * (1 + (double) subBucket / SUB_BUCKETS);
+}
+
+static std::string formatTime(double microseconds) {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(microseconds < 10000 ? 1 : 0);
+    if (microseconds < 1000) stream << microseconds << " us";
+    else stream << microseconds / 1000 << " ms";
+    return stream.str();
+}
+
+std::string formatBenchmarkReport(std::vector<BenchmarkSample> samples, const BenchmarkConfig& config) {
+    std::vector<double> wall;
+    double cpuTotal = 0, cpuMax = 0;
+    long peakRss = 0;
+    std::map<int, size_t> histogram;
+    for (auto& sample: samples) {
+        wall.push_back(sample.wallMicroseconds);
+        cpuTotal += sample.cpuMicroseconds;
+        cpuMax = std::max(cpuMax, sample.cpuMicroseconds);
+        peakRss = std::max(peakRss, sample.peakRssKilobytes);
+        ++histogram[bucketOf(sample.wallMicroseconds)];
+    }
+    std::sort(wall.begin(), wall.end());
+    double cpuMean = samples.empty() ? 0 : cpuTotal / samples.size();
+
+    std::ostringstream report;
+    if (config.json) {
+        report << std::fixed << std::setprecision(1);
+        report << "{\"runs\":" << samples.size() << ",\"warmup\":" << config.warmup << ",\"parallel\":" << config.parallel
+               << ",\"wall_us\":{\"min\":" << percentile(wall, 0) << ",\"median\":" << percentile(wall, 0.5)
+               << ",\"p90\":" << percentile(wall, 0.9) << ",\"p99\":" << percentile(wall, 0.99)
+               << ",\"max\":" << (wall.empty() ? 0 : wall.back()) << "}"
+               << ",\"cpu_us\":{\"mean\":" << cpuMean << ",\"max\":" << cpuMax << "}"
+               << ",\"peak_rss_kb\":" << peakRss << ",\"histogram\":[";
+        bool first = true;
+        for (auto& bucket: histogram) {
+            report << (first ? "" : ",") << "{\"from_us\":" << bucketStart(bucket.first)
+                   << ",\"to_us\":" << bucketStart(bucket.first + 1) << ",\"count\":" << bucket.second << "}";
+            first = false;
+        }
+        report << "]}\n";
+        return report.str();
+    }
+
+    report << "runs: " << samples.size() << " (warmup " << config.warmup << ", parallel " << config.parallel << ")\n"
+           << "wall:  min " << formatTime(percentile(wall, 0)) << ", median " << formatTime(percentile(wall, 0.5))
+           << ", p90 " << formatTime(percentile(wall, 0.9)) << ", p99 " << formatTime(percentile(wall, 0.99))
+           << ", max " << formatTime(wall.empty() ? 0 : wall.back()) << "\n"
+           << "cpu:   mean " << formatTime(cpuMean) << ", max " << formatTime(cpuMax) << "\n"
+           << "rss:   peak " << peakRss << " KB\n";
+
+    size_t maxCount = 0;
+    for (auto& bucket: histogram) maxCount = std::max(maxCount, bucket.second);
+    if (histogram.empty()) return report.str();
+
+    const int width = 40;
+    report << "histogram:\n";
+    for (int bucket = histogram.begin()->first; bucket <= histogram.rbegin()->first; ++bucket) {
+        size_t count = histogram.count(bucket) ? histogram[bucket] : 0;
+        report << std::setw(10) << std::right << formatTime(bucketStart(bucket)) << " - "
+               << std::setw(10) << std::left << formatTime(bucketStart(bucket + 1)) << " |"
+               << std::string(count * width / maxCount, '#') << " " << count << "\n";
+    }
+    return report.str();
+}
@@ -0,0 +1,121 @@
+#include "fanout.h"
+#include "filef.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+
+static const int FANOUT_PIPE_SIZE = 1024 * 1024;
+// Stalls shorter than this are not reported
+static const double FANOUT_REPORT_MS = 1000;
+
+// Removes the given number of bytes from the pipe without copying them
+static bool discard(int pipe, int devNull, size_t size) {
+    while (size > 0) {
+        ssize_t result = splice(pipe, nullptr, devNull, nullptr, size, SPLICE_F_MOVE);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        size -= result;
+    }
+    return true;
+}
+
+void relayFanOut(int input, const std::vector<int>& outputs, const std::vector<std::string>& names) {
+    // a consumer that exits early should not kill the others
+    signal(SIGPIPE, SIG_IGN);
+
+    // The data is staged in a private pipe: tee(2) duplicates it to every consumer and it is dropped
+    // only after all of them got it. A consumer may receive only a part of the staged data when its pipe
+    // is full, so for each consumer we keep how much of the staged data it is ahead.
+    int stage[2];
+    int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (devNull < 0 || pipe2(stage, O_CLOEXEC) < 0) {
+        filef(STDERR_FILENO, "Could not start fan-out relay\n");
+        return;
+    }
+    int stageSize = fcntl(stage[1], F_SETPIPE_SZ, FANOUT_PIPE_SIZE);
+    if (stageSize < 0) stageSize = fcntl(stage[1], F_GETPIPE_SZ);
+    for (int output: outputs) fcntl(output, F_SETPIPE_SZ, stageSize);
+
+    size_t consumers = outputs.size();
+    std::vector<size_t> ahead(consumers, 0);
+    std::vector<bool> open(consumers, true);
+    std::vector<double> stalledMs(consumers, 0);
+    size_t staged = 0;
+
+    while (true) {
+        if (staged == 0) {
+            ssize_t result = splice(input, nullptr, stage[1], nullptr, (size_t) stageSize, SPLICE_F_MOVE);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) break;
+            staged = (size_t) result;
+        }
+
+        // duplicate the staged data to consumers that have received all the previous data
+        std::vector<pollfd> waiting;
+        std::vector<size_t> waitingConsumers;
+        for (size_t i = 0; i < consumers; ++i) {
+            if (!open[i] || ahead[i] != 0) continue;
+
+            ssize_t result = tee(stage[0], outputs[i], staged, SPLICE_F_NONBLOCK);
+            if (result > 0) {
+                ahead[i] = (size_t) result;
+            } else if (result == 0 || errno == EAGAIN || errno == EINTR) {
+                waiting.push_back(pollfd{outputs[i], POLLOUT, 0});
+                waitingConsumers.push_back(i);
+            } else {
+                open[i] = false;
+                close(outputs[i]);
+            }
+        }
+
+        // drop the data that every consumer already has
+        bool anyOpen = false;
+        size_t delivered = staged;
+        for (size_t i = 0; i < consumers; ++i) {
+            if (!open[i]) continue;
+            anyOpen = true;
+            if (ahead[i] < delivered) delivered = ahead[i];
+        }
+        if (!anyOpen) break;
+
+        if (delivered > 0) {
+            if (!discard(stage[0], devNull, delivered)) break;
+            for (size_t i = 0; i < consumers; ++i) {
+                if (open[i]) ahead[i] -= delivered;
+            }
+            staged -= delivered;
+            continue;
+        }
+
+        // the slowest consumers are full - wait for them
+        auto start = std::chrono::steady_clock::now();
+        if (poll(waiting.data(), waiting.size(), -1) < 0 && errno != EINTR) break;
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        for (size_t i: waitingConsumers) stalledMs[i] += elapsed;
+    }
+
+    for (size_t i = 0; i < consumers; ++i) {
+        if (open[i]) close(outputs[i]);
+    }
+    close(stage[0]);
+    close(stage[1]);
+    close(devNull);
+    close(input);
+
+    std::ostringstream report;
+    for (size_t i = 0; i < consumers; ++i) {
+        if (stalledMs[i] >= FANOUT_REPORT_MS) {
+            report << "Fan-out: consumer (" << names[i] << ") stalled the producer for "
+                   << (long long) stalledMs[i] << " ms\n";
+        }
+    }
+    std::cerr << report.str();
+}
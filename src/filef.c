@@ -0,0 +1,180 @@
+#include "filef.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/uio.h>
+
+// Large enough for the most of the messages to be written at once
+#define MESSAGE_STORAGE 512
+
+static const char digit_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+static const char hex_digits[] = "0123456789abcdef";
+
+static int writev_all(int file, struct iovec* parts, int part_number) {
+    while (part_number) {
+        ssize_t number_written = writev(file, parts, part_number);
+        if (number_written < 0) {
+            if (errno != EINTR) return 1;
+            continue;
+        }
+        // skip what was written
+        while (part_number && (size_t) number_written >= parts->iov_len) {
+            number_written -= parts->iov_len;
+            ++parts;
+            --part_number;
+        }
+        if (part_number) {
+            parts->iov_base = (char*) parts->iov_base + number_written;
+            parts->iov_len -= number_written;
+        }
+    }
+    return 0;
+}
+
+void filef_buffer_init(struct filef_buffer* buffer, int file, char* storage, size_t capacity) {
+    buffer->file = file;
+    buffer->data = storage;
+    buffer->size = 0;
+    buffer->capacity = capacity;
+}
+
+int filef_flush(struct filef_buffer* buffer) {
+    struct iovec part = {buffer->data, buffer->size};
+    buffer->size = 0;
+    return writev_all(buffer->file, &part, part.iov_len ? 1 : 0);
+}
+
+// A piece that does not fit is written together with the buffered data
+static int append(struct filef_buffer* buffer, const char* piece, size_t length) {
+    if (buffer->size + length <= buffer->capacity) {
+        memcpy(buffer->data + buffer->size, piece, length);
+        buffer->size += length;
+        return 0;
+    }
+    struct iovec parts[2] = {{buffer->data, buffer->size}, {(char*) piece, length}};
+    buffer->size = 0;
+    return writev_all(buffer->file, parts, 2);
+}
+
+static int append_padding(struct filef_buffer* buffer, size_t length) {
+    static const char spaces[] = "                                ";
+    while (length) {
+        size_t part = length < sizeof(spaces) - 1 ? length : sizeof(spaces) - 1;
+        if (append(buffer, spaces, part)) return 1;
+        length -= part;
+    }
+    return 0;
+}
+
+static int append_aligned(struct filef_buffer* buffer, const char* piece, size_t length, size_t width, int left) {
+    size_t padding = width > length ? width - length : 0;
+    if (!left && append_padding(buffer, padding)) return 1;
+    if (append(buffer, piece, length)) return 1;
+    return left ? append_padding(buffer, padding) : 0;
+}
+
+// Writes the number backwards from end two digits at a time, returns the start
+static char* format_decimal(unsigned long long value, char* end) {
+    while (value >= 100) {
+        const char* pair = &digit_pairs[(value % 100) * 2];
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        *--end = digit_pairs[value * 2 + 1];
+        *--end = digit_pairs[value * 2];
+    } else {
+        *--end = (char) ('0' + value);
+    }
+    return end;
+}
+
+static char* format_hex(unsigned long long value, char* end) {
+    do {
+        *--end = hex_digits[value & 0xF];
+        value >>= 4;
+    } while (value);
+    return end;
+}
+
+int vbfilef(struct filef_buffer* buffer, const char* format, va_list list) {
+    const char* literal = format;
+    const char* position = format;
+
+    while (*position) {
+        if (*position != '%') {
+            ++position;
+            continue;
+        }
+
+        // %[-][width][z](s|c|d|u|x|%)
+        const char* conversion = position + 1;
+        int left = *conversion == '-';
+        if (left) ++conversion;
+        size_t width = 0;
+        while (*conversion >= '0' && *conversion <= '9') width = width * 10 + (*conversion++ - '0');
+        int size_t_argument = *conversion == 'z';
+        if (size_t_argument) ++conversion;
+        if (!strchr("scdux%", *conversion) || !*conversion || (size_t_argument && *conversion != 'u')) {
+            ++position;
+            continue;
+        }
+
+        // print the text before
+        if (position > literal && append(buffer, literal, position - literal)) return 1;
+        position = literal = conversion + 1;
+
+        char number[24];
+        char* end = number + sizeof(number);
+        char* piece;
+        if (*conversion == 's') {
+            const char* string = va_arg(list, const char*);
+            if (append_aligned(buffer, string, strlen(string), width, left)) return 1;
+            continue;
+        } else if (*conversion == '%' || *conversion == 'c') {
+            number[0] = *conversion == '%' ? '%' : (char) va_arg(list, int);
+            piece = number;
+            end = number + 1;
+        } else if (*conversion == 'd') {
+            int integer = va_arg(list, int);
+            unsigned long long magnitude = integer < 0 ? -(unsigned long long) integer : (unsigned long long) integer;
+            piece = format_decimal(magnitude, end);
+            if (integer < 0) *--piece = '-';
+        } else if (*conversion == 'u') {
+            unsigned long long value = size_t_argument ? va_arg(list, size_t) : va_arg(list, unsigned int);
+            piece = format_decimal(value, end);
+        } else {
+            piece = format_hex(va_arg(list, unsigned int), end);
+        }
+        if (append_aligned(buffer, piece, end - piece, width, left)) return 1;
+    }
+
+    if (position > literal) return append(buffer, literal, position - literal);
+    return 0;
+}
+
+int bfilef(struct filef_buffer* buffer, const char* format, ...) {
+    va_list list;
+    va_start(list, format);
+    int result = vbfilef(buffer, format, list);
+    va_end(list);
+    return result;
+}
+
+int filef(int file_number, const char* format, ...) {
+    char storage[MESSAGE_STORAGE];
+    struct filef_buffer buffer;
+    filef_buffer_init(&buffer, file_number, storage, sizeof(storage));
+
+    va_list list;
+    va_start(list, format);
+    int result = vbfilef(&buffer, format, list);
+    va_end(list);
+
+    return filef_flush(&buffer) || result;
+}
@@ -0,0 +1,186 @@
+#include "ioBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+const size_t IOBuffer::NO_LIMIT;
+const size_t IOBuffer::MIN_CHUNK;
+const size_t IOBuffer::MAX_CHUNK;
+
+IOBuffer::IOBuffer(const IOBuffer& other): limit(other.limit) {
+    *this = other;
+}
+
+IOBuffer& IOBuffer::operator=(const IOBuffer& other) {
+    if (this == &other) return *this;
+    clear();
+    limit = other.limit;
+    for (auto& region: other.data()) append((const char*) region.iov_base, region.iov_len);
+    wasTruncated = other.wasTruncated;
+    return *this;
+}
+
+size_t IOBuffer::nextChunkSize() const {
+    if (chunks.empty()) return MIN_CHUNK;
+    return std::min(std::max(chunks.back().capacity * 2, MIN_CHUNK), MAX_CHUNK);
+}
+
+size_t IOBuffer::readAll(int file) {
+    while (readSome(file) != 0);
+    return stored;
+}
+
+size_t IOBuffer::readSome(int file) {
+    if (!spare.data) {
+        spare.capacity = nextChunkSize();
+        spare.data.reset(new char[spare.capacity]);
+    }
+    spare.start = spare.end = 0;
+
+    iovec regions[2];
+    int regionNumber = 0;
+    bool tailUsed = !chunks.empty() && chunks.back().end < chunks.back().capacity;
+    if (tailUsed) {
+        Chunk& tail = chunks.back();
+        regions[regionNumber++] = iovec{tail.data.get() + tail.end, tail.capacity - tail.end};
+    }
+    regions[regionNumber++] = iovec{spare.data.get(), spare.capacity};
+
+    ssize_t read;
+    while (true) {
+        errno = 0;
+        read = readv(file, regions, regionNumber);
+        if (read >= 0) break;
+        if (errno != EINTR) throw std::runtime_error("Cannot read from given file!");
+    }
+
+    commit((size_t) read, tailUsed);
+    return (size_t) read;
+}
+
+void IOBuffer::commit(size_t read, bool tailUsed) {
+    size_t accepted = std::min(read, limit - stored);
+    if (accepted < read) wasTruncated = true;
+    stored += accepted;
+
+    if (tailUsed) {
+        Chunk& tail = chunks.back();
+        size_t toTail = std::min(accepted, tail.capacity - tail.end);
+        tail.end += toTail;
+        accepted -= toTail;
+    }
+    if (accepted > 0) {
+        spare.end = accepted;
+        chunks.push_back(std::move(spare));
+        spare = Chunk{nullptr, 0, 0, 0};
+    }
+}
+
+void IOBuffer::append(const char* data, size_t size) {
+    size = std::min(size, limit - stored);
+    stored += size;
+
+    while (size > 0) {
+        if (chunks.empty() || chunks.back().end == chunks.back().capacity) {
+            size_t capacity = std::max(nextChunkSize(), std::min(size, MAX_CHUNK));
+            chunks.push_back(Chunk{std::unique_ptr<char[]>(new char[capacity]), capacity, 0, 0});
+        }
+        Chunk& tail = chunks.back();
+        size_t copied = std::min(size, tail.capacity - tail.end);
+        std::memcpy(tail.data.get() + tail.end, data, copied);
+        tail.end += copied;
+        data += copied;
+        size -= copied;
+    }
+}
+
+void IOBuffer::writeAll(int file) const {
+    std::vector<iovec> regions = data();
+    size_t first = 0;
+
+    while (first < regions.size()) {
+        int regionNumber = (int) std::min(regions.size() - first, (size_t) IOV_MAX);
+        errno = 0;
+        ssize_t written = writev(file, &regions[first], regionNumber);
+        if (written < 0) {
+            if (errno != EINTR) throw std::runtime_error("Cannot write to given file!");
+            continue;
+        }
+
+        // skip the written regions and move the start of a partially written one
+        size_t left = (size_t) written;
+        while (first < regions.size() && left >= regions[first].iov_len) {
+            left -= regions[first].iov_len;
+            ++first;
+        }
+        if (first < regions.size()) {
+            regions[first].iov_base = (char*) regions[first].iov_base + left;
+            regions[first].iov_len -= left;
+        }
+    }
+}
+
+std::vector<iovec> IOBuffer::data() const {
+    std::vector<iovec> regions;
+    regions.reserve(chunks.size());
+    for (auto& chunk: chunks) {
+        if (chunk.end > chunk.start) regions.push_back(iovec{chunk.data.get() + chunk.start, chunk.end - chunk.start});
+    }
+    return regions;
+}
+
+void IOBuffer::consume(size_t size) {
+    size = std::min(size, stored);
+    stored -= size;
+
+    size_t consumedChunks = 0;
+    for (auto& chunk: chunks) {
+        size_t consumed = std::min(size, chunk.end - chunk.start);
+        chunk.start += consumed;
+        size -= consumed;
+        if (chunk.start != chunk.end || &chunk == &chunks.back()) break;
+        ++consumedChunks;
+    }
+    chunks.erase(chunks.begin(), chunks.begin() + consumedChunks);
+}
+
+std::string IOBuffer::str() const {
+    std::string result;
+    result.reserve(stored);
+    for (auto& chunk: chunks) result.append(chunk.data.get() + chunk.start, chunk.end - chunk.start);
+    return result;
+}
+
+std::string IOBuffer::str(size_t size) const {
+    std::string result;
+    result.reserve(std::min(size, stored));
+    for (auto& chunk: chunks) {
+        if (size == 0) break;
+        size_t copied = std::min(size, chunk.end - chunk.start);
+        result.append(chunk.data.get() + chunk.start, copied);
+        size -= copied;
+    }
+    return result;
+}
+
+size_t IOBuffer::find(char c, size_t limit) const {
+    size_t offset = 0;
+    for (auto& chunk: chunks) {
+        if (offset >= limit) break;
+        size_t length = std::min(chunk.end - chunk.start, limit - offset);
+        const void* found = std::memchr(chunk.data.get() + chunk.start, c, length);
+        if (found) return offset + ((const char*) found - (chunk.data.get() + chunk.start));
+        offset += length;
+    }
+    return std::string::npos;
+}
+
+void IOBuffer::clear() {
+    chunks.clear();
+    stored = 0;
+    wasTruncated = false;
+}
@@ -3,10 +3,17 @@
 #include <unordered_map>
 #include <string>
 #include <vector>
+#include <functional>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
 
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include <fstream>
 
 #include <boost/filesystem.hpp>
@@ -17,6 +24,18 @@
 #include "CommandPart.h"
 #include "redirectsParser.h"
 #include "system_read_write.h"
+#include "startupProfile.h"
+#include "scheduling.h"
+#include "fanout.h"
+#include "ioBuffer.h"
+#include "recordReader.h"
+#include "arithmetic.h"
+#include "parameterExpansion.h"
+#include "testCommand.h"
+#include "benchmark.h"
+#include "metrics.h"
+#include "argumentBatch.h"
+#include "filef.h"
 
 char** convertToCArgs(const std::vector<std::string>& variables) {
     char** result = new char*[variables.size() + 1];
@@ -67,10 +86,10 @@ int openSystem(std::string errorString, const char *pathname, int flags, mode_t
     return result;
 }
 
-int waitSystem(int pid, int& errorno) {
+int waitSystem(int pid, int& errorno, struct rusage* usage=nullptr) {
     int result;
     errno = 0;
-    while ((result = waitpid(pid, &errorno, 0)) < 0) {
+    while ((result = wait4(pid, &errorno, 0, usage)) < 0) {
         if (errno != EINTR) break;
         errno = 0;
     }
@@ -85,12 +104,17 @@ struct Redirecting {
 
     // should be false if there is nothing receiving on the other end
     bool redirectIfBuiltIn = true;
-    std::string builtInStdOut;
-    std::string builtInStdErr;
+    IOBuffer builtInStdOut;
+    IOBuffer builtInStdErr;
     bool isBuiltIn = false;
 
-    int childPid;
+    int childPid = -1;
     bool wait = true;
+    // called after all the commands of the line are started, before waiting for them
+    std::function<void()> beforeWait;
+
+    // mrun options applied in the child
+    Scheduling scheduling;
 
     int get(int from) {
         return redirects.count(from) ? redirects[from] : from;
@@ -151,39 +175,145 @@ class MyShell {
 
     variables_t variables;
     variables_t envVariables;
+    bool envLoaded = false;
+    std::string binPath;
+    std::string startupDir;
     std::string workingDir;
+    // the shell changes its working directory with fchdir, relative paths are resolved against this descriptor
+    int workingDirFd = AT_FDCWD;
     int errorno = 0;
+    StartupProfile& profile;
+
+    struct Substitution {
+        int file;
+        pid_t pid;
+    };
+    // process substitutions of the line being expanded
+    std::vector<Substitution> substitutions;
+
+    struct Coprocess {
+        pid_t pid;
+        int in;
+        int out;
+    };
+    std::map<std::string, Coprocess> coprocesses;
+    // read-ahead of mread
+    RecordReader recordReader;
+    // compiled $(( )) expressions, scripts repeat the same lines
+    std::unordered_map<std::string, ArithmeticExpression> arithmeticCache;
+    static const size_t ARITHMETIC_CACHE_SIZE = 1024;
+    // stat results of mtest, valid until the next line or started process
+    StatCache statCache;
+
+    // resources used by the children waited for since the last reset (mbench)
+    struct ChildUsage {
+        double cpuMicroseconds = 0;
+        long peakRssKilobytes = 0;
+    } childUsage;
+    // wait also for the commands on the left of pipes (mbench)
+    bool waitForAll = false;
+    // the commands started in the background keep the standard input, set in a fan-out consumer
+    // whose first command reads from the relay
+    bool inheritStdin = false;
+
+    // shared with the forked children
+    Metrics* metrics = Metrics::create();
+    std::chrono::steady_clock::time_point metricsWritten = std::chrono::steady_clock::now();
 
 public:
-    MyShell(std::string path="") {
-        workingDir = boost::filesystem::current_path().string() + "/";
+    MyShell(StartupProfile& profile, std::string path=""): binPath(std::move(path)), profile(profile) {
+        profile.measure("working directory", [this]() {
+            workingDirFd = openSystem("Cannot open the working directory", ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            workingDir = currentDirectoryName(boost::filesystem::current_path().string());
+        });
+        startupDir = workingDir;
+    };
 
-        for (size_t i = 0; environ[i] != nullptr; ++i) {
-            assignVariable(environ[i], envVariables);
-        }
+    ~MyShell() {
+        while (!coprocesses.empty()) stopCoprocess(coprocesses.begin()->first);
+        exportMetrics(true);
+    }
+
+    // Writes the metrics to MSTATS_FILE at most every MSTATS_INTERVAL seconds (10 by default)
+    void exportMetrics(bool force=false) {
+        std::string path = lookupSetting("MSTATS_FILE");
+        if (path.empty()) return;
 
-        std::string binDir = workingDir;
-        if (!path.empty()) {
-            boost::filesystem::path tryBinPath = boost::filesystem::path(path).parent_path().string();
-            if (boost::filesystem::is_directory(tryBinPath)) binDir = tryBinPath.lexically_normal().string();
-            tryBinPath = boost::filesystem::path(workingDir + "/" + tryBinPath.string());
-            if (boost::filesystem::is_directory(tryBinPath)) binDir = tryBinPath.lexically_normal().string();
+        double interval = 10;
+        try {
+            std::string intervalString = lookupSetting("MSTATS_INTERVAL");
+            if (!intervalString.empty()) interval = std::stod(intervalString);
+        } catch (...) {}
+
+        auto now = std::chrono::steady_clock::now();
+        if (!force && std::chrono::duration<double>(now - metricsWritten).count() < interval) return;
+        metricsWritten = now;
+        if (!metrics->writeTo(path)) filef(STDERR_FILENO, "Could not write metrics to %s\n", path.c_str());
+    }
+
+    pid_t forkProcess() {
+        metrics->forks.fetch_add(1, std::memory_order_relaxed);
+        return fork();
+    }
+
+    // Name of the current directory ending with a slash, the fallback is used if it is too long for getcwd
+    static std::string currentDirectoryName(const std::string& fallback) {
+        std::string name;
+        std::vector<char> buffer(PATH_MAX);
+        if (getcwd(buffer.data(), buffer.size())) {
+            name = buffer.data();
+        } else {
+            name = boost::filesystem::path{fallback}.lexically_normal().string();
+            if (name[name.length() - 1] == '.') name = name.substr(0, name.length() - 1);
         }
-        envVariables["PATH"] = envVariables["PATH"] + ":" + binDir;
-    };
+        if (name[name.length() - 1] != '/') name += '/';
+        return name;
+    }
+
+    // The environment is only parsed when the first command needs it
+    variables_t& environment() {
+        if (envLoaded) return envVariables;
+        envLoaded = true;
+
+        profile.measure("environment (lazy)", [this]() {
+            for (size_t i = 0; environ[i] != nullptr; ++i) {
+                assignVariable(environ[i], envVariables);
+            }
+        });
+
+        profile.measure("binary directory (lazy)", [this]() {
+            std::string binDir = startupDir;
+            if (!binPath.empty()) {
+                boost::filesystem::path tryBinPath = boost::filesystem::path(binPath).parent_path().string();
+                if (boost::filesystem::is_directory(tryBinPath)) binDir = tryBinPath.lexically_normal().string();
+                tryBinPath = boost::filesystem::path(startupDir + "/" + tryBinPath.string());
+                if (boost::filesystem::is_directory(tryBinPath)) binDir = tryBinPath.lexically_normal().string();
+            }
+            envVariables["PATH"] = envVariables["PATH"] + ":" + binDir;
+        });
+        return envVariables;
+    }
 
     void run() {
         char *s;
 
+        // readline is only needed for the interactive mode
+        profile.measure("readline", []() {
+            rl_initialize();
+            using_history();
+        });
+
         std::string printString = workingDir + " > ";
         while ((s = readline(printString.c_str())) != nullptr) {
             add_history(s);
 
             try {
-                executeSingleLine(CommandPart{std::string(s)});
+                profile.measure("first command", [this, s]() { executeSingleLine(CommandPart{std::string(s)}); });
             } catch(std::exception &e) {
-                std::cerr << e.what() << std::endl;
+                filef(STDERR_FILENO, "%s\n", e.what());
             }
+            profile.report();
+            exportMetrics();
 
             free(s);
             printString = workingDir + " > ";
@@ -191,7 +321,7 @@ public:
     }
     void run(std::string script) {
         if (!boost::filesystem::is_regular_file(script)) {
-           std::cerr << "Could not find file: " << script << std::endl;
+           filef(STDERR_FILENO, "Could not find file: %s\n", script.c_str());
            return;
         }
         std::ifstream infile(script);
@@ -199,37 +329,183 @@ public:
         std::string s;
         while (std::getline(infile, s)) {
             try {
-                executeSingleLine(CommandPart{s});
+                profile.measure("first command", [this, &s]() { executeSingleLine(CommandPart{s}); });
             } catch(std::exception &e) {
-                std::cerr << e.what() << std::endl;
+                filef(STDERR_FILENO, "%s\n", e.what());
             }
+            profile.report();
+            exportMetrics();
         }
+        profile.report();
     }
 
     void expandSingleLine(CommandPart part, std::vector<CommandPart>& result) {
         std::vector<CommandPart> parts = part.splitCommand();
 
+        // mbatch expands its wild cards itself, while the batches are started
+        size_t commandStart = result.size();
+        bool deferWildCards = false;
         for (auto& part: parts) {
             // Deal with comments
             if (!part.quotes && part.includesEntering('#')) {
                 // Expand the part before comment and stop
                 CommandPart before, after;
                 std::tie(before, after) = part.splitFirstEntering('#');
-                if (!before.empty()) expandCommandPart(before, result);
+                if (!before.empty()) expandCommandPart(before, result, true, !deferWildCards);
                 break;
             }
-            expandCommandPart(part, result);
+            size_t expandedStart = result.size();
+            expandCommandPart(part, result, true, !deferWildCards);
+            if (deferWildCards && !part.quotes) {
+                for (size_t i = expandedStart; i < result.size(); ++i) result[i].deferredWildCard = isWildCard(result[i]);
+            }
+
+            if (result.empty()) continue;
+            CommandPart& last = result.back();
+            if ((last == "|" || last == "|>" || last == "&") && !last.escaped[0]) {
+                commandStart = result.size();
+                deferWildCards = false;
+            } else if (result.size() == commandStart + 1) {
+                deferWildCards = last == "mbatch";
+            }
+        }
+    }
+
+    // Environment variables take precedence over the shell variables, nullptr if not set
+    const std::string* findVariable(const std::string& key) {
+        variables_t& environmentVariables = environment();
+        auto variable = environmentVariables.find(key);
+        if (variable != environmentVariables.end() && !variable->second.empty()) return &variable->second;
+        auto shellVariable = variables.find(key);
+        if (shellVariable != variables.end()) return &shellVariable->second;
+        return variable == environmentVariables.end() ? nullptr : &variable->second;
+    }
+
+    std::string lookupVariable(const std::string& key) {
+        const std::string* value = findVariable(key);
+        return value ? *value : "";
+    }
+
+    // Same precedence as lookupVariable, but reads the process environment directly
+    // while it is not loaded, for the settings checked after every line
+    std::string lookupSetting(const std::string& key) {
+        if (envLoaded) return lookupVariable(key);
+        const char* value = getenv(key.c_str());
+        if (value && *value) return value;
+        auto shellVariable = variables.find(key);
+        if (shellVariable != variables.end()) return shellVariable->second;
+        return value ? value : "";
+    }
+
+    ParameterContext parameterContext() {
+        ParameterContext context;
+        context.lookup = [this](const std::string& name) { return findVariable(name); };
+        context.assign = [this](const std::string& name, const std::string& value) { variables[name] = value; };
+        context.expandWord = [this](CommandPart& word) {
+            std::vector<CommandPart> parts = word.splitCommand();
+            std::vector<CommandPart> expanded;
+            for (auto& part: parts) expandCommandPart(part, expanded, true, false);
+            return CommandPart::join(expanded, ' ').string;
+        };
+        context.evaluate = [this](const std::string& expression) { return evaluateArithmetic(expression); };
+        return context;
+    }
+
+    // Position of the next ${ or $(( in a word
+    static size_t findExpansion(CommandPart& part, size_t from=0) {
+        for (size_t i = from; i + 1 < part.size(); ++i) {
+            if (part[i] != '$' || part.escaped[i] || part.escaped[i + 1]) continue;
+            if (part[i + 1] == '{') return i;
+            if (part[i + 1] == '(' && i + 2 < part.size() && part[i + 2] == '(' && !part.escaped[i + 2]) return i;
+        }
+        return std::string::npos;
+    }
+
+    // Replaces the ${...} and $((...)) within a word by their values, the values are escaped and not expanded again
+    CommandPart substituteExpansions(CommandPart& part) {
+        CommandPart result;
+        size_t copied = 0;
+        for (size_t start = findExpansion(part); start != std::string::npos; start = findExpansion(part, copied)) {
+            size_t end = start + 2;
+            std::string value;
+            if (part[start + 1] == '{') {
+                while (end < part.size() && (part[end] != '}' || part.escaped[end])) ++end;
+                if (end == part.size()) throw std::invalid_argument("Bad substitution");
+
+                CommandPart parameter = part.subPart(start + 2, end);
+                parameter.quotes = '{';
+                value = expandParameter(parameter, parameterContext());
+            } else {
+                for (size_t depth = 1; end < part.size(); ++end) {
+                    if (part.escaped[end]) continue;
+                    if (part[end] == '(') ++depth;
+                    else if (part[end] == ')' && --depth == 0) break;
+                }
+                if (end == part.size() || part[end - 1] != ')') throw std::invalid_argument("Bad substitution");
+                value = std::to_string(evaluateArithmetic(part.string.substr(start + 3, end - start - 4)));
+            }
+
+            result.string += part.string.substr(copied, start - copied) + value;
+            result.escaped.insert(result.escaped.end(), part.escaped.begin() + copied, part.escaped.begin() + start);
+            result.escaped.insert(result.escaped.end(), value.length(), true);
+            copied = end + 1;
+        }
+        result.string += part.string.substr(copied);
+        result.escaped.insert(result.escaped.end(), part.escaped.begin() + copied, part.escaped.end());
+        return result;
+    }
+
+    // $(( ... )) - the content of the substitution is enclosed in a single pair of parentheses
+    static bool isArithmetic(CommandPart& part) {
+        if (part.size() < 2 || part[0] != '(' || part.escaped[0]) return false;
+        size_t depth = 0;
+        for (size_t i = 0; i < part.size(); ++i) {
+            if (part.escaped[i]) continue;
+            if (part[i] == '(') ++depth;
+            else if (part[i] == ')' && --depth == 0) return i == part.size() - 1;
+        }
+        return false;
+    }
+
+    int64_t evaluateArithmetic(const std::string& expression) {
+        auto cached = arithmeticCache.find(expression);
+        if (cached == arithmeticCache.end()) {
+            if (arithmeticCache.size() >= ARITHMETIC_CACHE_SIZE) arithmeticCache.clear();
+            cached = arithmeticCache.emplace(expression, ArithmeticExpression{expression}).first;
+        }
+        return cached->second.evaluate([this](const std::string& name) { return lookupVariable(name); });
+    }
+
+    // MCAPTURE_LIMIT variable limits the size of command substitution output
+    size_t captureLimit() {
+        std::string limit = lookupSetting("MCAPTURE_LIMIT");
+        if (limit.empty()) return IOBuffer::NO_LIMIT;
+        try {
+            return std::stoull(limit);
+        } catch (...) {
+            throw std::invalid_argument("Invalid MCAPTURE_LIMIT: " + limit);
         }
     }
 
     void expandCommandPart(CommandPart& part, std::vector<CommandPart>& result, bool expandVariables=true, bool expandWildCards=true) {
-        if (part.quotes == '"') {
-            std::vector<CommandPart> parts = part.splitEntering(' ');
+        if (part.quotes == '(') {
+            // groups are expanded when they are executed
+            result.push_back(part);
+        }
+        else if (expandVariables && (part.quotes == '<' || part.quotes == '>')) {
+            result.emplace_back(substituteProcess(part), false);
+        }
+        else if (part.quotes == '"') {
+            CommandPart quoted = expandVariables ? substituteExpansions(part) : part;
+            std::vector<CommandPart> parts = quoted.splitEntering(' ');
             std::vector<CommandPart> subResult;
             // expand each of parts separately
             for (auto subPart: parts) expandCommandPart(subPart, subResult, expandVariables, false);
             result.push_back(CommandPart::join(subResult, ' '));
         }
+        else if (expandVariables && part.quotes == '$' && isArithmetic(part)) {
+            result.emplace_back(std::to_string(evaluateArithmetic(part.string.substr(1, part.size() - 2))), false);
+        }
         else if (expandVariables && part.quotes == '$') {
             int pipefd[2];
             callSystem("Error creating pipe.", pipe, pipefd);
@@ -239,16 +515,43 @@ public:
             redirecting.addFileToClose(pipefd[0]);
             redirecting.addParentFileToClose(pipefd[1]);
 
-            executeSingleLine(part, redirecting);
+            // read the output while the commands are running so that they don't block on a full pipe
+            IOBuffer buffer{captureLimit()};
+            redirecting.beforeWait = [&buffer, &pipefd]() { buffer.readAll(pipefd[0]); };
+
+            try {
+                executeSingleLine(part, redirecting);
+            } catch (...) {
+                close(pipefd[0]);
+                throw;
+            }
+            close(pipefd[0]);
+
             std::string value;
             if (redirecting.isBuiltIn) {
-                value = redirecting.builtInStdOut;
+                value = redirecting.builtInStdOut.str();
             } else {
-                value = readAll(pipefd[0]);
+                if (buffer.truncated())
+                    filef(STDERR_FILENO, "Output of $(%s) truncated to %zu bytes\n", part.string.c_str(), buffer.size());
+                metrics->substitutionBytes.fetch_add(buffer.size(), std::memory_order_relaxed);
+                value = buffer.str();
             }
 
             if (!value.empty()) result.push_back(value);
         }
+        else if (expandVariables && part.quotes == '{') {
+            std::string value = expandParameter(part, parameterContext());
+            if (!value.empty()) {
+                CommandPart valuePart{value, false};
+                std::vector<CommandPart> subParts = valuePart.splitCommand();
+                for (auto& subPart: subParts) expandCommandPart(subPart, result, false, expandWildCards);
+            }
+        }
+        else if (expandVariables && !part.quotes && findExpansion(part) != std::string::npos) {
+            // pre${var}post and a$((1 + 1))b are single words
+            CommandPart substituted = substituteExpansions(part);
+            expandCommandPart(substituted, result, true, expandWildCards);
+        }
         else if (part.includesEntering('=')) {
             CommandPart first, second;
             std::tie(first, second) = part.splitFirstEntering('=');
@@ -259,11 +562,14 @@ public:
             if (!second.empty()) expandCommandPart(second, subResult);
             if (!subResult.empty()) result.push_back(CommandPart::join(subResult, ' '));
         }
+        else if (expandVariables && part.findEntering('$') != std::string::npos &&
+                 isDescriptorRedirect(part.subPart(0, part.findEntering('$')))) {
+            // redirect to a descriptor stored in a variable, e.g. >&$COPROC_IN
+            size_t dollar = part.findEntering('$');
+            result.emplace_back(part.string.substr(0, dollar) + lookupVariable(part.string.substr(dollar + 1)), false);
+        }
         else if (expandVariables && part.string[0] == '$' && !part.escaped[0]) {
-            std::string key = part.string.substr(1);
-            std::string value;
-            value = envVariables[key];
-            if (value.empty()) value = variables[key];
+            std::string value = lookupVariable(part.string.substr(1));
             if (!value.empty()) {
                 CommandPart valuePart{value, false};
                 // expand the value
@@ -273,7 +579,10 @@ public:
         }
         else if (expandWildCards && isWildCard(part)) {
             // expand each wildCard
-            std::vector<std::string> expandedPart = expandWildCard(part);
+            size_t scannedEntries = 0;
+            std::vector<std::string> expandedPart = expandWildCard(part, &scannedEntries);
+            metrics->wildcardExpansions.fetch_add(1, std::memory_order_relaxed);
+            metrics->wildcardEntriesScanned.fetch_add(scannedEntries, std::memory_order_relaxed);
             result.insert(result.end(), expandedPart.begin(), expandedPart.end());
         }
         else {
@@ -281,6 +590,254 @@ public:
         }
     }
 
+    // Should only be called in the mbatch subshell. The command and the arguments before the first wild card are
+    // repeated in every batch, wild cards are expanded while the batches are started. Returns the exit code.
+    int executeBatches(std::vector<CommandPart>& lineParts, size_t commandStart, size_t parallel, size_t maxArguments) {
+        size_t batchedStart = commandStart + 1;
+        while (batchedStart < lineParts.size() && !lineParts[batchedStart].deferredWildCard) ++batchedStart;
+        std::vector<std::string> fixed;
+        for (size_t i = commandStart; i < batchedStart; ++i) fixed.push_back(lineParts[i].string);
+        ArgumentBatch batch(fixed, ArgumentBatch::systemLimit(environment()), maxArguments);
+
+        std::vector<pid_t> running;
+        int exitCode = 0;
+        auto waitBatch = [&](pid_t pid) {
+            int status;
+            pid = waitSystem(pid, status);
+            auto finished = std::find(running.begin(), running.end(), pid);
+            if (finished == running.end()) return;
+            running.erase(finished);
+            // like xargs, the exit code tells that some of the batches failed
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) exitCode = 123;
+        };
+        auto startBatch = [&]() {
+            while (running.size() >= parallel) waitBatch(-1);
+            std::vector<std::string> commandLine = batch.take();
+            std::vector<CommandPart> batchParts(commandLine.begin(), commandLine.end());
+            Redirecting batchRedirecting;
+            executeSingleCommand(batchParts, batchRedirecting, true);
+            if (batchRedirecting.isBuiltIn) {
+                batchRedirecting.builtInStdOut.writeAll(STDOUT_FILENO);
+                batchRedirecting.builtInStdErr.writeAll(STDERR_FILENO);
+            } else {
+                running.push_back(batchRedirecting.childPid);
+            }
+        };
+        auto addArgument = [&](const std::string& argument) {
+            if (!batch.fits(argument)) startBatch();
+            batch.add(argument);
+        };
+
+        for (size_t i = batchedStart; i < lineParts.size(); ++i) {
+            if (!lineParts[i].deferredWildCard) {
+                addArgument(lineParts[i].string);
+                continue;
+            }
+            size_t scannedEntries = 0;
+            size_t matches = forEachWildCardMatch(lineParts[i], addArgument, &scannedEntries);
+            metrics->wildcardExpansions.fetch_add(1, std::memory_order_relaxed);
+            metrics->wildcardEntriesScanned.fetch_add(scannedEntries, std::memory_order_relaxed);
+            if (matches == 0) throw std::runtime_error("Wild card " + lineParts[i].string + " could not be extended.");
+        }
+        if (!batch.empty() || batchedStart == lineParts.size()) startBatch();
+        while (!running.empty()) waitBatch(running.front());
+        return exitCode;
+    }
+
+    // Closes the pipes of process substitutions that won't be used and waits for their commands
+    void discardSubstitutions(std::vector<Substitution>& discarded) {
+        for (auto& substitution: discarded) close(substitution.file);
+        for (auto& substitution: discarded) {
+            int status;
+            waitSystem(substitution.pid, status);
+        }
+        discarded.clear();
+    }
+
+    // Runs the already expanded line the given number of times with the output discarded.
+    // A line with process substitutions is given unexpanded and expanded for every run,
+    // so that every run starts and waits for its own substitutions.
+    std::vector<BenchmarkSample> benchmarkRuns(std::vector<CommandPart>& lineParts, size_t runs, size_t warmup,
+                                               const CommandPart* line=nullptr) {
+        int devNull = openSystem("Cannot open file /dev/null", "/dev/null", O_WRONLY | O_CLOEXEC);
+        std::vector<BenchmarkSample> samples;
+        bool previousWaitForAll = waitForAll;
+        waitForAll = true;
+
+        try {
+            for (size_t i = 0; i < warmup + runs; ++i) {
+                Redirecting redirecting;
+                redirecting.set(STDOUT_FILENO, devNull);
+                std::vector<Substitution> runSubstitutions;
+                std::vector<CommandPart> runParts;
+                childUsage = ChildUsage{};
+
+                auto start = std::chrono::steady_clock::now();
+                if (line) {
+                    substitutions.swap(runSubstitutions);
+                    try {
+                        expandSingleLine(*line, runParts);
+                    } catch (...) {
+                        substitutions.swap(runSubstitutions);
+                        discardSubstitutions(runSubstitutions);
+                        throw;
+                    }
+                    substitutions.swap(runSubstitutions);
+                }
+                executeLineParts(line ? runParts : lineParts, runSubstitutions, redirecting);
+                double wall = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+                if (i >= warmup) samples.push_back(BenchmarkSample{wall, childUsage.cpuMicroseconds, childUsage.peakRssKilobytes});
+            }
+        } catch (...) {
+            waitForAll = previousWaitForAll;
+            close(devNull);
+            throw;
+        }
+        waitForAll = previousWaitForAll;
+        close(devNull);
+        return samples;
+    }
+
+    // Splits the runs between the given number of subshells that run at the same time
+    std::vector<BenchmarkSample> benchmarkParallel(std::vector<CommandPart>& lineParts, const BenchmarkConfig& config,
+                                                   const CommandPart* line=nullptr) {
+        int pipefd[2];
+        callSystem("Error creating pipe.", pipe2, pipefd, O_CLOEXEC);
+        std::cout.flush();
+        std::cerr.flush();
+
+        std::vector<pid_t> workers;
+        for (size_t worker = 0; worker < config.parallel; ++worker) {
+            size_t runs = config.runs / config.parallel + (worker < config.runs % config.parallel ? 1 : 0);
+            pid_t pid = forkProcess();
+            if (pid == -1) break;
+            if (pid == 0) {
+                close(pipefd[0]);
+                try {
+                    std::vector<BenchmarkSample> samples = benchmarkRuns(lineParts, runs, config.warmup, line);
+                    // each sample is written at once, so that the samples of the workers don't mix
+                    for (auto& sample: samples) write_from_buffer(pipefd[1], (char*) &sample, sizeof(sample));
+                } catch (std::exception& e) {
+                    filef(STDERR_FILENO, "%s\n", e.what());
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            workers.push_back(pid);
+        }
+        close(pipefd[1]);
+
+        IOBuffer buffer;
+        try {
+            buffer.readAll(pipefd[0]);
+        } catch (...) {
+            close(pipefd[0]);
+            throw;
+        }
+        close(pipefd[0]);
+        for (pid_t worker: workers) {
+            int status;
+            waitSystem(worker, status);
+        }
+        if (workers.size() != config.parallel) throw std::runtime_error("Could not start new process");
+
+        std::string data = buffer.str();
+        std::vector<BenchmarkSample> samples(data.size() / sizeof(BenchmarkSample));
+        if (!samples.empty()) std::memcpy(samples.data(), data.data(), samples.size() * sizeof(BenchmarkSample));
+        return samples;
+    }
+
+    // Starts a long-lived command with its stdin and stdout connected to the shell.
+    // NAME_IN and NAME_OUT variables store the descriptors to write to it and read from it.
+    void startCoprocess(const std::string& name, std::vector<CommandPart>& commandParts) {
+        if (coprocesses.count(name)) stopCoprocess(name);
+
+        int inPipe[2], outPipe[2];
+        callSystem("Error creating pipe.", pipe2, inPipe, O_CLOEXEC);
+        try {
+            callSystem("Error creating pipe.", pipe2, outPipe, O_CLOEXEC);
+        } catch (...) {
+            close(inPipe[0]);
+            close(inPipe[1]);
+            throw;
+        }
+
+        Redirecting redirecting;
+        redirecting.set(STDIN_FILENO, inPipe[0]);
+        redirecting.set(STDOUT_FILENO, outPipe[1]);
+        redirecting.addParentFileToClose(inPipe[0]);
+        redirecting.addParentFileToClose(outPipe[1]);
+        try {
+            executeSingleCommand(commandParts, redirecting, true);
+            if (redirecting.isBuiltIn) throw std::invalid_argument("A built-in command cannot be a coprocess");
+        } catch (...) {
+            redirecting.closeParent();
+            close(inPipe[1]);
+            close(outPipe[0]);
+            throw;
+        }
+
+        coprocesses[name] = Coprocess{redirecting.childPid, inPipe[1], outPipe[0]};
+        variables[name + "_IN"] = std::to_string(inPipe[1]);
+        variables[name + "_OUT"] = std::to_string(outPipe[0]);
+        variables[name + "_PID"] = std::to_string(redirecting.childPid);
+    }
+
+    // Closes the input of the coprocess and waits for it to finish
+    void stopCoprocess(const std::string& name) {
+        Coprocess coprocess = coprocesses[name];
+        coprocesses.erase(name);
+        variables.erase(name + "_IN");
+        variables.erase(name + "_OUT");
+        variables.erase(name + "_PID");
+
+        close(coprocess.in);
+        close(coprocess.out);
+        recordReader.forget(coprocess.out);
+        waitSystem(coprocess.pid, errorno);
+        errorno = errorno >> 8;
+    }
+
+    // Starts the command with a pipe to the shell, returns the /dev/fd path of the shell's end of the pipe.
+    // The end is left without close-on-exec for the command that receives the path.
+    std::string substituteProcess(CommandPart& command) {
+        bool input = command.quotes == '<';
+        int pipefd[2];
+        callSystem("Error creating pipe.", pipe, pipefd);
+        int childFile = input ? pipefd[1] : pipefd[0];
+        int shellFile = input ? pipefd[0] : pipefd[1];
+
+        std::cout.flush();
+        std::cerr.flush();
+        pid_t pid = forkProcess();
+        if (pid == -1) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+            throw std::runtime_error("Could not start new process");
+        }
+        else if (pid == 0) {
+            close(shellFile);
+            for (auto& substitution: substitutions) close(substitution.file);
+            substitutions.clear();
+            callSystem("Could not replace file descriptor.", dup2, childFile, input ? STDOUT_FILENO : STDIN_FILENO);
+            close(childFile);
+
+            try {
+                executeSingleLine(command);
+            } catch (std::exception &e) {
+                filef(STDERR_FILENO, "%s\n", e.what());
+                _exit(1);
+            }
+            std::cout.flush();
+            _exit(errorno);
+        }
+
+        close(childFile);
+        substitutions.push_back(Substitution{shellFile, pid});
+        return "/dev/fd/" + std::to_string(shellFile);
+    }
+
     static void printHelp(const CommandPart command, Redirecting& redirecting) {
         if (command == "mexport") redirecting.builtInStdOut = "mexport <var_name>[=VAL]\nStores the value as global variable\n";
         else if (command == "merrno") redirecting.builtInStdOut = "merrno [-h|--help] – display the end code of the last program or command\n";
@@ -289,6 +846,18 @@ public:
         else if (command == "mexit") redirecting.builtInStdOut = "mexit [exit code] [-h|--help]  – exit from myshell with [exit code]\n";
         else if (command == "mecho") redirecting.builtInStdOut = "mecho [text|$<var_name>] [text|$<var_name>]  [text|$<var_name>] - print arguments\n";
         else if (command == ".") redirecting.builtInStdOut = ". [script] Execute the given script\n";
+        else if (command == "mcoproc") redirecting.builtInStdOut = "mcoproc <name> [command] - start command as a coprocess, write to it with >&$<name>_IN\n"
+                                                                   "     and read from it with <&$<name>_OUT. Without the command - stop the coprocess\n";
+        else if (command == "mread") redirecting.builtInStdOut = "mread [-d delim] [-n count] [var_name]... - read a line from stdin and split it into variables\n";
+        else if (command == "mtest" || command == "[") redirecting.builtInStdOut = "mtest <expression> | [ <expression> ] - check files, strings or integers, result is in merrno\n";
+        else if (command == "mbench") redirecting.builtInStdOut = "mbench [-n runs] [-w warmup] [-j parallel] [--json] <command>|(<pipeline>) - run repeatedly and\n"
+                                                                  "     report wall time percentiles, cpu time, peak rss and a latency histogram\n";
+        else if (command == "mstats") redirecting.builtInStdOut = "mstats [-h|--help] - print the shell metrics in Prometheus text format\n"
+                                                                  "     (also written to $MSTATS_FILE every $MSTATS_INTERVAL seconds and at exit)\n";
+        else if (command == "mbatch") redirecting.builtInStdOut = "mbatch [-j parallel] [-n max_args] <command> [args] <wildcard|arg>... - run command like xargs,\n"
+                                                                  "     the arguments from the first wild card on are split into batches that fit ARG_MAX\n";
+        else if (command == "mrun") redirecting.builtInStdOut = "mrun [--cpus=LIST] [--nodes=LIST] [--nice=N] [--ioclass=realtime|best-effort|idle] [--ioprio=0-7]\n"
+                                                                "     [--rlimit-<as|core|cpu|data|fsize|memlock|nofile|nproc|stack>=N[K|M|G|T]] <command> - run command with the given scheduling\n";
     };
 
     static bool isHelpPrint(std::vector<CommandPart> lineParts, Redirecting& redirecting) {
@@ -327,7 +896,9 @@ public:
     }
 
     void execute(const CommandPart path, std::vector<CommandPart>& arguments, Redirecting& redirecting, bool wait=true) {
-        pid_t pid = fork();
+        // load the environment before forking so that the child doesn't parse it on its own
+        environment();
+        pid_t pid = forkProcess();
         if (pid == -1) {
             throw std::runtime_error("Could not start new process");
         }
@@ -336,6 +907,7 @@ public:
             redirecting.closeParent();
             redirecting.childPid = pid;
             redirecting.wait = wait;
+            statCache.clear();
         }
         else {
             std::vector<std::string> args(arguments.size());
@@ -344,18 +916,32 @@ public:
             char** variablesString = convertToCVariables(envVariables);
 
             if (!wait) {
-                close(STDOUT_FILENO); close(STDERR_FILENO); close(STDIN_FILENO);
+                close(STDOUT_FILENO); close(STDERR_FILENO);
+                if (!inheritStdin) close(STDIN_FILENO);
             }
             redirecting.apply();
             redirecting.closeChild();
+            applyScheduling(redirecting);
             execve(path.string.c_str(), (char **) argumentsString, (char **) variablesString);
+            metrics->execFailures.fetch_add(1, std::memory_order_relaxed);
 
             exit(1);
         }
     }
 
+    // Should only be called in the child process
+    static void applyScheduling(const Redirecting& redirecting) {
+        if (redirecting.scheduling.empty()) return;
+        try {
+            redirecting.scheduling.apply();
+        } catch (std::exception& e) {
+            filef(STDERR_FILENO, "mrun: %s\n", e.what());
+            exit(1);
+        }
+    }
+
     void executeShellScript(CommandPart script, Redirecting& redirecting) {
-        pid_t pid = fork();
+        pid_t pid = forkProcess();
         if (pid == -1) {
             throw std::runtime_error("Could not start new process");
         }
@@ -368,27 +954,161 @@ public:
         }
         else {
             if (!wait) {
-                close(STDOUT_FILENO); close(STDERR_FILENO); close(STDIN_FILENO);
+                close(STDOUT_FILENO); close(STDERR_FILENO);
+                if (!inheritStdin) close(STDIN_FILENO);
             }
             redirecting.apply();
             redirecting.closeChild();
+            applyScheduling(redirecting);
             run(script.string);
             exit(1);
         }
     }
 
+    // Starts the relay and a subshell for each consumer, the consumers write to the final redirecting
+    void executeFanOut(int input, std::vector<CommandPart>& consumers, Redirecting& finalRedirecting,
+                       std::vector<Redirecting>& allRedirectings) {
+        std::vector<int> readEnds, writeEnds;
+        std::vector<std::string> names;
+        auto closeAll = [&]() {
+            for (int fd: readEnds) close(fd);
+            for (int fd: writeEnds) close(fd);
+            close(input);
+        };
+
+        // the children should not print what is buffered in this process
+        std::cout.flush();
+        std::cerr.flush();
+
+        try {
+            for (auto& consumer: consumers) {
+                int pipefd[2];
+                callSystem("Error creating pipe.", pipe, pipefd);
+                readEnds.push_back(pipefd[0]);
+                writeEnds.push_back(pipefd[1]);
+                names.push_back(consumer.string);
+            }
+
+            Redirecting relayRedirecting;
+            pid_t pid = forkProcess();
+            if (pid == -1) throw std::runtime_error("Could not start new process");
+            if (pid == 0) {
+                for (int fd: readEnds) close(fd);
+                // files kept open for built-in commands
+                for (auto& redirecting: allRedirectings) redirecting.closeParent();
+                finalRedirecting.closeParent();
+                relayFanOut(input, writeEnds, names);
+                _exit(0);
+            }
+            relayRedirecting.childPid = pid;
+            allRedirectings.push_back(relayRedirecting);
+
+            for (size_t i = 0; i < consumers.size(); ++i) {
+                Redirecting consumerRedirecting;
+                pid = forkProcess();
+                if (pid == -1) throw std::runtime_error("Could not start new process");
+                if (pid == 0) {
+                    for (size_t j = 0; j < consumers.size(); ++j) {
+                        if (j != i) close(readEnds[j]);
+                        close(writeEnds[j]);
+                    }
+                    close(input);
+                    for (auto& redirecting: allRedirectings) redirecting.closeParent();
+                    finalRedirecting.set(STDIN_FILENO, readEnds[i]);
+                    finalRedirecting.addFileToClose(readEnds[i]);
+                    finalRedirecting.apply();
+                    finalRedirecting.closeChild();
+                    finalRedirecting.closeParent();
+
+                    inheritStdin = true;
+                    try {
+                        executeSingleLine(consumers[i]);
+                    } catch (std::exception &e) {
+                        filef(STDERR_FILENO, "%s\n", e.what());
+                        _exit(1);
+                    }
+                    std::cout.flush();
+                    _exit(errorno);
+                }
+                consumerRedirecting.childPid = pid;
+                allRedirectings.push_back(consumerRedirecting);
+            }
+        } catch (...) {
+            closeAll();
+            throw;
+        }
+
+        closeAll();
+        finalRedirecting.closeParent();
+    }
+
     void executeSingleLine(CommandPart line) { Redirecting redirecting{}; executeSingleLine(line, redirecting); }
     void executeSingleLine(CommandPart line, Redirecting& finalRedirecting) {
         // split line into parts, while expanding all the wildcards and variables
+        statCache.setDirectory(workingDirFd);
+        statCache.clear();
+
         std::vector<CommandPart> lineParts;
-        expandSingleLine(CommandPart(std::move(line)), lineParts);
+        std::vector<Substitution> lineSubstitutions;
+        // a command substitution executes its line in the middle of the expansion
+        substitutions.swap(lineSubstitutions);
+        auto expansionStart = std::chrono::steady_clock::now();
+        try {
+            expandSingleLine(CommandPart(std::move(line)), lineParts);
+            metrics->expansionSeconds.observe(
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - expansionStart).count());
+        } catch (...) {
+            substitutions.swap(lineSubstitutions);
+            for (auto& substitution: lineSubstitutions) close(substitution.file);
+            throw;
+        }
+        substitutions.swap(lineSubstitutions);
 
-        if (lineParts.empty()) return;
+        executeLineParts(lineParts, lineSubstitutions, finalRedirecting);
+    }
 
+    void executeLineParts(std::vector<CommandPart>& lineParts, std::vector<Substitution>& lineSubstitutions,
+                          Redirecting& finalRedirecting) {
         // Deal with all the redirects and pipes
         std::vector<CommandPart> currentCommandParts;
         Redirecting currentCommandRedirecting;
         std::vector<Redirecting> allRedirectings;
+        // a fan-out is started at the end of the line, after the redirects of its consumers
+        std::vector<CommandPart> fanOutConsumers;
+        int fanOutInput = -1;
+
+        // The pipe of a process substitution stays open only in the command that got its path
+        std::vector<bool> substitutionUsed(lineSubstitutions.size());
+        for (auto& substitution: lineSubstitutions) {
+            Redirecting substitutionRedirecting;
+            substitutionRedirecting.childPid = substitution.pid;
+            allRedirectings.push_back(substitutionRedirecting);
+        }
+        auto attachSubstitutions = [&](std::vector<CommandPart>& commandParts, Redirecting& redirecting) {
+            for (size_t i = 0; i < lineSubstitutions.size(); ++i) {
+                std::string path = "/dev/fd/" + std::to_string(lineSubstitutions[i].file);
+                bool used = false;
+                for (auto& part: commandParts) used = used || part == path;
+
+                if (used && !substitutionUsed[i]) {
+                    redirecting.addParentFileToClose(lineSubstitutions[i].file);
+                    substitutionUsed[i] = true;
+                } else if (!used) {
+                    redirecting.addFileToClose(lineSubstitutions[i].file);
+                }
+            }
+        };
+        auto closeSubstitutions = [&]() {
+            for (size_t i = 0; i < lineSubstitutions.size(); ++i) {
+                if (!substitutionUsed[i]) close(lineSubstitutions[i].file);
+                substitutionUsed[i] = true;
+            }
+        };
+
+        if (lineParts.empty()) {
+            closeSubstitutions();
+            return;
+        }
 
         try {
             for (size_t i = 0; i < lineParts.size(); ++i) {
@@ -405,6 +1125,7 @@ public:
                     currentCommandRedirecting.set(STDOUT_FILENO, pipefd[1]);
                     currentCommandRedirecting.addFileToClose(pipefd[0]);
                     currentCommandRedirecting.addParentFileToClose(pipefd[1]);
+                    attachSubstitutions(currentCommandParts, currentCommandRedirecting);
                     executeSingleCommand(currentCommandParts, currentCommandRedirecting, false);
                     allRedirectings.push_back(currentCommandRedirecting);
                     currentCommandParts = {};
@@ -415,9 +1136,34 @@ public:
                     currentCommandRedirecting.addParentFileToClose(pipefd[0]);
                     currentCommandRedirecting.addFileToClose(pipefd[1]);
                 }
+                // Fan-out
+                else if (linePart == "|>" && !linePart.escaped[0]) {
+                    if (currentCommandParts.empty()) throw std::invalid_argument("No command supplied to fan-out on left");
+
+                    std::vector<CommandPart> consumers;
+                    for (++i; i < lineParts.size() && lineParts[i].quotes == '('; ++i) consumers.push_back(lineParts[i]);
+                    if (consumers.empty()) throw std::invalid_argument("No commands supplied to fan-out on right");
+                    // only redirects of the consumers may follow
+                    --i;
+
+                    int pipefd[2];
+                    callSystem("Error creating pipe.", pipe, pipefd);
+
+                    currentCommandRedirecting.set(STDOUT_FILENO, pipefd[1]);
+                    currentCommandRedirecting.addFileToClose(pipefd[0]);
+                    currentCommandRedirecting.addParentFileToClose(pipefd[1]);
+                    attachSubstitutions(currentCommandParts, currentCommandRedirecting);
+                    executeSingleCommand(currentCommandParts, currentCommandRedirecting, false);
+                    allRedirectings.push_back(currentCommandRedirecting);
+                    currentCommandParts = {};
+                    currentCommandRedirecting = Redirecting{};
+
+                    fanOutInput = pipefd[0];
+                    fanOutConsumers = std::move(consumers);
+                }
                 // Redirect
                 else if (isRedirect(linePart)) {
-                    if (currentCommandParts.empty())
+                    if (currentCommandParts.empty() && fanOutInput == -1)
                         throw std::invalid_argument("No command supplied to redirect on left");
 
                     int from, direction, to;
@@ -443,15 +1189,19 @@ public:
                             currentCommandRedirecting.addFileToClose(fd);
                         }
                     } else {
-                        if (direction == -1) currentCommandRedirecting.set(to, from);
-                        else currentCommandRedirecting.set(from, to);
+                        // both N<&M and N>&M make N a copy of M
+                        currentCommandRedirecting.set(from, to);
                     }
                 }
+                else if (fanOutInput != -1) {
+                    throw std::invalid_argument("Expected (command) or a redirect after |>, got " + linePart.string);
+                }
                 // In background
                 else if (linePart == "&" && !linePart.escaped[0]) {
                     if (currentCommandParts.empty())
                         throw std::invalid_argument("No command supplied to run in background");
 
+                    attachSubstitutions(currentCommandParts, currentCommandRedirecting);
                     executeSingleCommand(currentCommandParts, currentCommandRedirecting, false);
                     allRedirectings.push_back(currentCommandRedirecting);
                     currentCommandParts = {};
@@ -462,14 +1212,23 @@ public:
             }
 
             // Final command in the end
-            if (currentCommandParts.empty()) {
+            if (fanOutInput != -1) {
+                finalRedirecting.merge(currentCommandRedirecting);
+                int input = fanOutInput;
+                fanOutInput = -1;
+                executeFanOut(input, fanOutConsumers, finalRedirecting, allRedirectings);
+            } else if (currentCommandParts.empty()) {
                 if (!currentCommandRedirecting.empty()) throw std::invalid_argument("Expected a command.");
             } else {
                 finalRedirecting.merge(currentCommandRedirecting);
+                attachSubstitutions(currentCommandParts, finalRedirecting);
                 executeSingleCommand(currentCommandParts, finalRedirecting, true);
                 allRedirectings.push_back(finalRedirecting);
             }
 
+            // substitutions that are not arguments of any command (e.g. used as a redirect target)
+            closeSubstitutions();
+
             // Perform the built-in commands
             int builtInRedirectings = 0;
             for (auto &redirecting: allRedirectings) {
@@ -482,8 +1241,8 @@ public:
                     if (redirecting.redirectIfBuiltIn) {
                         // apply redirecting with ability to return back
                         redirecting.apply(true);
-                        if (!redirecting.builtInStdOut.empty()) std::cout << redirecting.builtInStdOut;
-                        if (!redirecting.builtInStdErr.empty()) std::cerr << redirecting.builtInStdErr;
+                        redirecting.builtInStdOut.writeAll(STDOUT_FILENO);
+                        redirecting.builtInStdErr.writeAll(STDERR_FILENO);
                         redirecting.revert();
                     }
                     // close all the files that should have been closed
@@ -491,16 +1250,33 @@ public:
                 }
             }
 
+            if (finalRedirecting.beforeWait) finalRedirecting.beforeWait();
+
             // Wait for all other children
+            auto waitStart = std::chrono::steady_clock::now();
+            bool waited = false;
             for (auto& redirecting: allRedirectings) {
-                if (redirecting.wait) {
-                    waitSystem(redirecting.childPid, errorno);
+                if ((redirecting.wait || waitForAll) && redirecting.childPid != -1) {
+                    struct rusage usage{};
+                    waitSystem(redirecting.childPid, errorno, &usage);
                     errorno = errorno >> 8;
+
+                    childUsage.cpuMicroseconds += usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec +
+                                                  usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec;
+                    childUsage.peakRssKilobytes = std::max(childUsage.peakRssKilobytes, usage.ru_maxrss);
+                    waited = true;
                 }
             }
+            if (waited) {
+                metrics->waitSeconds.observe(
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count());
+            }
         } catch(...) {
             // close all possibly open files
             for (auto& redirecting: allRedirectings) redirecting.closeParent();
+            currentCommandRedirecting.closeParent();
+            if (fanOutInput != -1) close(fanOutInput);
+            closeSubstitutions();
             throw;
         }
     }
@@ -508,6 +1284,8 @@ public:
     void executeSingleCommand(std::vector<CommandPart>& lineParts, Redirecting& redirecting, bool wait=true) {
         // BUILT-IN COMMANDS
         CommandPart command = lineParts[0];
+        // mrun is counted as the command it runs
+        if (!(command == "mrun")) metrics->commands.fetch_add(1, std::memory_order_relaxed);
         if (command == ".") {
             if (isHelpPrint(lineParts, redirecting)) {
                 redirecting.isBuiltIn = true;
@@ -521,6 +1299,245 @@ public:
 
             executeShellScript(lineParts[1].string, redirecting);
         }
+        else if (command == "mcoproc") {
+            redirecting.isBuiltIn = true;
+            if (lineParts.size() == 2 && isHelpPrint(lineParts, redirecting)) return;
+            if (lineParts.size() < 2) {
+                redirecting.builtInStdErr = "Invalid number of arguments";
+                return;
+            }
+            std::string name = lineParts[1].string;
+            if (lineParts.size() == 2) {
+                if (!coprocesses.count(name)) {
+                    redirecting.builtInStdErr = "No such coprocess: " + name + "\n";
+                    return;
+                }
+                stopCoprocess(name);
+                return;
+            }
+            std::vector<CommandPart> commandParts(lineParts.begin() + 2, lineParts.end());
+            startCoprocess(name, commandParts);
+        }
+        else if (command == "mread") {
+            redirecting.isBuiltIn = true;
+            if (isHelpPrint(lineParts, redirecting)) return;
+
+            char delimiter = '\n';
+            size_t count = IOBuffer::NO_LIMIT;
+            std::vector<std::string> names;
+            for (size_t i = 1; i < lineParts.size(); ++i) {
+                if ((lineParts[i] == "-d" || lineParts[i] == "-n") && i + 1 < lineParts.size()) {
+                    if (lineParts[i] == "-d") {
+                        delimiter = lineParts[i + 1].string.empty() ? '\0' : lineParts[i + 1][0];
+                    } else {
+                        try {
+                            count = std::stoull(lineParts[i + 1].string);
+                        } catch (...) {
+                            redirecting.builtInStdErr = "Invalid argument provided";
+                            return;
+                        }
+                    }
+                    ++i;
+                } else {
+                    names.push_back(lineParts[i].string);
+                }
+            }
+            if (names.empty()) names.emplace_back("REPLY");
+
+            int file = redirecting.get(STDIN_FILENO);
+            std::string record;
+            bool read = recordReader.read(file, delimiter, count, record);
+            // the descriptor is closed after this command
+            for (int parentFile: redirecting.parentFilesToClose) {
+                if (parentFile == file) recordReader.forget(file);
+            }
+
+            // split into words, the last variable gets the rest of the record
+            size_t position = 0;
+            for (size_t i = 0; i < names.size(); ++i) {
+                position = std::min(record.find_first_not_of(" \t", position), record.length());
+                size_t end = i == names.size() - 1 ? record.length() : std::min(record.find_first_of(" \t", position), record.length());
+                std::string value = record.substr(position, end - position);
+                if (i == names.size() - 1) value = value.substr(0, value.find_last_not_of(" \t") + 1);
+                variables[names[i]] = value;
+                position = end;
+            }
+            errorno = read ? 0 : 1;
+        }
+        else if (command == "mtest" || command == "[") {
+            redirecting.isBuiltIn = true;
+            if (lineParts.size() == 2 && isHelpPrint(lineParts, redirecting)) return;
+
+            size_t end = lineParts.size();
+            if (command == "[") {
+                if (!(lineParts[end - 1] == "]")) {
+                    redirecting.builtInStdErr = "Missing ]\n";
+                    errorno = 2;
+                    return;
+                }
+                --end;
+            }
+            std::vector<std::string> arguments;
+            for (size_t i = 1; i < end; ++i) arguments.push_back(lineParts[i].string);
+
+            try {
+                errorno = evaluateTest(arguments, statCache) ? 0 : 1;
+            } catch (std::invalid_argument& e) {
+                redirecting.builtInStdErr = std::string(e.what()) + "\n";
+                errorno = 2;
+            }
+        }
+        else if (command == "mbench") {
+            redirecting.isBuiltIn = true;
+            if (lineParts.size() == 2 && isHelpPrint(lineParts, redirecting)) return;
+
+            BenchmarkConfig config;
+            size_t i = 1;
+            for (; i < lineParts.size(); ++i) {
+                std::string option = lineParts[i].string;
+                if (option == "--json") {
+                    config.json = true;
+                    continue;
+                }
+                if (lineParts[i].quotes || (option != "-n" && option != "-w" && option != "-j")) break;
+                if (i + 1 == lineParts.size()) {
+                    redirecting.builtInStdErr = "Expected a value for " + option + "\n";
+                    return;
+                }
+                size_t value;
+                try {
+                    value = std::stoull(lineParts[++i].string);
+                } catch (...) {
+                    redirecting.builtInStdErr = "Invalid argument provided\n";
+                    return;
+                }
+                if (option == "-n") config.runs = value;
+                else if (option == "-w") config.warmup = value;
+                else config.parallel = std::max(value, (size_t) 1);
+            }
+            if (i == lineParts.size()) {
+                redirecting.builtInStdErr = "No command supplied to mbench\n";
+                return;
+            }
+
+            // the line is expanded once and reused for all the runs
+            std::vector<CommandPart> benchmarkParts;
+            const CommandPart* benchmarkLine = nullptr;
+            if (lineParts[i].quotes == '(' && i + 1 == lineParts.size()) {
+                std::vector<Substitution> groupSubstitutions;
+                substitutions.swap(groupSubstitutions);
+                try {
+                    expandSingleLine(lineParts[i], benchmarkParts);
+                } catch (...) {
+                    substitutions.swap(groupSubstitutions);
+                    discardSubstitutions(groupSubstitutions);
+                    throw;
+                }
+                substitutions.swap(groupSubstitutions);
+                // the process substitutions are started again for each run
+                if (!groupSubstitutions.empty()) {
+                    discardSubstitutions(groupSubstitutions);
+                    benchmarkLine = &lineParts[i];
+                }
+            } else {
+                benchmarkParts.assign(lineParts.begin() + i, lineParts.end());
+            }
+            if (benchmarkParts.empty()) {
+                redirecting.builtInStdErr = "No command supplied to mbench\n";
+                return;
+            }
+
+            std::vector<BenchmarkSample> samples = config.parallel == 1 ?
+                    benchmarkRuns(benchmarkParts, config.runs, config.warmup, benchmarkLine) :
+                    benchmarkParallel(benchmarkParts, config, benchmarkLine);
+            redirecting.builtInStdOut = formatBenchmarkReport(samples, config);
+        }
+        else if (command == "mbatch") {
+            if (lineParts.size() == 2 && isHelpPrint(lineParts, redirecting)) {
+                redirecting.isBuiltIn = true;
+                return;
+            }
+            size_t parallel = 1;
+            size_t maxArguments = ArgumentBatch::NO_LIMIT;
+            size_t i = 1;
+            for (; i < lineParts.size(); ++i) {
+                std::string option = lineParts[i].string;
+                if (lineParts[i].quotes || (option != "-j" && option != "-n")) break;
+                redirecting.isBuiltIn = true;
+                if (i + 1 == lineParts.size()) {
+                    redirecting.builtInStdErr = "Expected a value for " + option + "\n";
+                    return;
+                }
+                size_t value;
+                try {
+                    value = std::stoull(lineParts[++i].string);
+                } catch (...) {
+                    redirecting.builtInStdErr = "Invalid argument provided\n";
+                    return;
+                }
+                if (option == "-j") parallel = std::max(value, (size_t) 1);
+                else maxArguments = std::max(value, (size_t) 1);
+                redirecting.isBuiltIn = false;
+            }
+            if (i == lineParts.size()) {
+                redirecting.isBuiltIn = true;
+                redirecting.builtInStdErr = "No command supplied to mbatch\n";
+                return;
+            }
+
+            // the batches are started by a subshell, so that the pipes and redirects apply to all of them
+            environment();
+            std::cout.flush();
+            std::cerr.flush();
+            pid_t pid = forkProcess();
+            if (pid == -1) throw std::runtime_error("Could not start new process");
+            if (pid > 0) {
+                redirecting.closeParent();
+                redirecting.childPid = pid;
+                redirecting.wait = wait;
+                statCache.clear();
+                return;
+            }
+            if (!wait) {
+                close(STDOUT_FILENO); close(STDERR_FILENO);
+                if (!inheritStdin) close(STDIN_FILENO);
+            }
+            redirecting.apply();
+            redirecting.closeChild();
+            applyScheduling(redirecting);
+            try {
+                _exit(executeBatches(lineParts, i, parallel, maxArguments));
+            } catch (std::exception& e) {
+                filef(STDERR_FILENO, "mbatch: %s\n", e.what());
+                _exit(1);
+            }
+        }
+        else if (command == "mstats") {
+            redirecting.isBuiltIn = true;
+            if (isHelpPrint(lineParts, redirecting)) return;
+            if (lineParts.size() > 1) {
+                redirecting.builtInStdErr = "Invalid number of arguments";
+                return;
+            }
+            redirecting.builtInStdOut = metrics->format();
+        }
+        else if (command == "mrun") {
+            if (lineParts.size() == 2 && (lineParts[1] == "-h" || lineParts[1] == "--help")) {
+                redirecting.isBuiltIn = true;
+                printHelp(command, redirecting);
+                return;
+            }
+            size_t commandStart = redirecting.scheduling.parse(lineParts, 1);
+            if (commandStart == lineParts.size()) {
+                redirecting.isBuiltIn = true;
+                redirecting.builtInStdErr = "No command supplied to mrun\n";
+                return;
+            }
+            lineParts.erase(lineParts.begin(), lineParts.begin() + commandStart);
+            executeSingleCommand(lineParts, redirecting, wait);
+            if (redirecting.isBuiltIn && !redirecting.scheduling.empty())
+                redirecting.builtInStdErr += "mrun: scheduling options are ignored for built-in commands\n";
+        }
         else if (command == "mexport") {
             redirecting.isBuiltIn = true;
             if (isHelpPrint(lineParts, redirecting)) return;
@@ -529,7 +1546,7 @@ public:
                 return;
             }
             lineParts.erase(lineParts.begin());
-            assignVariable(lineParts, envVariables);
+            assignVariable(lineParts, environment());
         }
         else if (lineParts.size() > 1 && lineParts[1] == "=" && !lineParts[1].escaped[0]) {
             redirecting.isBuiltIn = true;
@@ -560,25 +1577,27 @@ public:
         else if (command == "mcd") {
             redirecting.isBuiltIn = true;
             if (isHelpPrint(lineParts, redirecting)) return;
-            if (lineParts.size() > 2) {
+            if (lineParts.size() != 2) {
                 redirecting.builtInStdErr = "Invalid number of arguments";
                 return;
             }
             std::string dirPart = lineParts[1].string;
-            std::string newWorkingDir;
-            if (dirPart[0] == '/') newWorkingDir = dirPart;
-            else newWorkingDir = workingDir + "/" + dirPart;
 
-            boost::filesystem::path dir{newWorkingDir};
-            if (!boost::filesystem::is_directory(dir)) {
+            int directory;
+            while ((directory = openat(workingDirFd, dirPart.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 && errno == EINTR);
+            if (directory < 0) {
                 redirecting.builtInStdErr = "Path not a directory";
                 return;
             }
-            workingDir = dir.lexically_normal().string();
-            if (workingDir[workingDir.length() - 1] == '.')
-                workingDir = workingDir.substr(0, workingDir.length() - 1);
-            if (workingDir[workingDir.length() - 1] != '/')
-                workingDir += '/';
+            if (fchdir(directory) < 0) {
+                close(directory);
+                redirecting.builtInStdErr = "Could not change directory";
+                return;
+            }
+            close(workingDirFd);
+            workingDirFd = directory;
+            statCache.setDirectory(workingDirFd);
+            workingDir = currentDirectoryName(dirPart[0] == '/' ? dirPart : workingDir + "/" + dirPart);
         }
         else if (command == "mexit") {
             redirecting.isBuiltIn = true;
@@ -597,6 +1616,7 @@ public:
                 }
             }
 
+            exportMetrics(true);
             _exit(exitCode);
         }
         else if (command == "mecho") {
@@ -612,11 +1632,11 @@ public:
 
         // CURRENT DIRECTORY COMMANDS
         else if (command.subPart(0, 2) == "./") {
-            boost::filesystem::path path = boost::filesystem::path{workingDir + "/" + command.string};
-            if (!boost::filesystem::is_regular_file(path))
+            struct stat fileStat;
+            if (fstatat(workingDirFd, command.string.c_str(), &fileStat, 0) < 0 || !S_ISREG(fileStat.st_mode))
                 throw std::invalid_argument("File not found: " + command.string);
-            std::string pathString = path.lexically_normal().string();
-            execute(pathString, lineParts, redirecting, wait);
+            // the process working directory follows workingDirFd, so the relative path names the same file
+            execute(command, lineParts, redirecting, wait);
         }
 
         // PATH COMMANDS
@@ -625,7 +1645,8 @@ public:
 
             size_t directoryI = 0;
             size_t prevDirectoryI = 0;
-            std::string path = envVariables["PATH"];
+            std::string path = environment()["PATH"];
+            metrics->pathLookups.fetch_add(1, std::memory_order_relaxed);
 
             while (directoryI != path.length()) {
                 directoryI = path.find(':', prevDirectoryI);
@@ -650,9 +1671,17 @@ public:
 
 
 int main(int argc, char** argv) {
-    MyShell shell{};
-    if (argc > 1) {
-        shell.run(argv[1]);
+    StartupProfile profile;
+    std::string script;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--startup-profile") profile.enable();
+        else if (script.empty()) script = arg;
+    }
+
+    MyShell shell{profile};
+    if (!script.empty()) {
+        shell.run(script);
     } else {
         shell.run();
     }
@@ -0,0 +1,80 @@
+#include "metrics.h"
+
+#include <new>
+#include <sstream>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "system_read_write.h"
+
+const double MetricsHistogram::BOUNDS[MetricsHistogram::BUCKETS] = {
+        0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5
+};
+
+void MetricsHistogram::observe(double seconds) {
+    size_t bucket = 0;
+    while (bucket < BUCKETS && seconds > BOUNDS[bucket]) ++bucket;
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    sumNanoseconds.fetch_add((uint64_t) (seconds * 1e9), std::memory_order_relaxed);
+}
+
+Metrics* Metrics::create() {
+    void* memory = mmap(nullptr, sizeof(Metrics), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) memory = ::operator new(sizeof(Metrics));
+    // value-initialization zeroes the counters
+    return new (memory) Metrics();
+}
+
+static void formatCounter(std::ostringstream& stream, const std::string& name, const std::string& help, uint64_t value) {
+    stream << "# HELP myshell_" << name << " " << help << "\n"
+           << "# TYPE myshell_" << name << " counter\n"
+           << "myshell_" << name << " " << value << "\n";
+}
+
+static void formatHistogram(std::ostringstream& stream, const std::string& name, const std::string& help,
+                            const MetricsHistogram& histogram) {
+    stream << "# HELP myshell_" << name << " " << help << "\n"
+           << "# TYPE myshell_" << name << " histogram\n";
+    uint64_t total = 0;
+    for (size_t i = 0; i <= MetricsHistogram::BUCKETS; ++i) {
+        total += histogram.counts[i].load(std::memory_order_relaxed);
+        stream << "myshell_" << name << "_bucket{le=\"";
+        if (i == MetricsHistogram::BUCKETS) stream << "+Inf";
+        else stream << MetricsHistogram::BOUNDS[i];
+        stream << "\"} " << total << "\n";
+    }
+    stream << "myshell_" << name << "_sum " << histogram.sumNanoseconds.load(std::memory_order_relaxed) / 1e9 << "\n"
+           << "myshell_" << name << "_count " << total << "\n";
+}
+
+std::string Metrics::format() const {
+    std::ostringstream stream;
+    formatCounter(stream, "commands_total", "Commands executed.", commands.load(std::memory_order_relaxed));
+    formatCounter(stream, "forks_total", "Processes forked.", forks.load(std::memory_order_relaxed));
+    formatCounter(stream, "exec_failures_total", "Failed execve calls.", execFailures.load(std::memory_order_relaxed));
+    formatCounter(stream, "path_lookups_total", "Commands looked up in PATH.", pathLookups.load(std::memory_order_relaxed));
+    formatCounter(stream, "wildcard_expansions_total", "Wild cards expanded.", wildcardExpansions.load(std::memory_order_relaxed));
+    formatCounter(stream, "wildcard_entries_scanned_total", "Directory entries scanned for wild cards.",
+                  wildcardEntriesScanned.load(std::memory_order_relaxed));
+    formatCounter(stream, "command_substitution_bytes_total", "Bytes captured by command substitution.",
+                  substitutionBytes.load(std::memory_order_relaxed));
+    formatHistogram(stream, "expansion_seconds", "Time spent expanding lines.", expansionSeconds);
+    formatHistogram(stream, "wait_seconds", "Time spent waiting for commands.", waitSeconds);
+    return stream.str();
+}
+
+bool Metrics::writeTo(const std::string& path) const {
+    std::string temporaryPath = path + ".tmp";
+    int file = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file < 0) return false;
+    try {
+        writeAll(file, format());
+    } catch (...) {
+        close(file);
+        return false;
+    }
+    close(file);
+    return rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
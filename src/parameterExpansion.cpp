@@ -0,0 +1,110 @@
+#include "parameterExpansion.h"
+
+#include <cctype>
+#include <stdexcept>
+#include "wildcards.h"
+
+static const std::string EMPTY;
+
+// Removes the shortest or longest prefix (or suffix) matching the pattern
+static std::string removeMatch(const std::string& value, CommandPart& pattern, bool prefix, bool longest) {
+    size_t length = value.length();
+    for (size_t i = 0; i <= length; ++i) {
+        size_t size = longest ? length - i : i;
+        if (prefix && testWildCard(value, 0, size, pattern)) return value.substr(size);
+        if (!prefix && testWildCard(value, length - size, length, pattern)) return value.substr(0, length - size);
+    }
+    return value;
+}
+
+// Replaces the longest matches of the pattern, only the first one if not `all`
+static std::string replaceMatches(const std::string& value, CommandPart& pattern, const std::string& replacement, bool all) {
+    if (pattern.empty()) return value;
+
+    std::string result;
+    size_t copied = 0;
+    for (size_t start = 0; start < value.length(); ++start) {
+        size_t end = value.length();
+        bool found = false;
+        for (; end > start && !found; --end) found = testWildCard(value, start, end, pattern);
+        if (!found) continue;
+        ++end;
+
+        result.append(value, copied, start - copied);
+        result += replacement;
+        copied = end;
+        start = end - 1;
+        if (!all) break;
+    }
+    result.append(value, copied, std::string::npos);
+    return result;
+}
+
+std::string expandParameter(CommandPart expression, const ParameterContext& context) {
+    if (expression.empty()) throw std::invalid_argument("Bad substitution: ${}");
+
+    bool length = expression[0] == '#' && !expression.escaped[0] && expression.size() > 1;
+    size_t nameStart = length ? 1 : 0;
+    size_t nameEnd = nameStart;
+    while (nameEnd < expression.size() && (std::isalnum((unsigned char) expression[nameEnd]) || expression[nameEnd] == '_')) ++nameEnd;
+    if (nameEnd == nameStart) throw std::invalid_argument("Bad substitution: ${" + expression.string + "}");
+
+    std::string name = expression.string.substr(nameStart, nameEnd - nameStart);
+    const std::string* variable = context.lookup(name);
+    const std::string& value = variable ? *variable : EMPTY;
+
+    if (length) {
+        if (nameEnd != expression.size()) throw std::invalid_argument("Bad substitution: ${" + expression.string + "}");
+        return std::to_string(value.length());
+    }
+    if (nameEnd == expression.size()) return value;
+
+    CommandPart rest = expression.subPart(nameEnd);
+    char op = rest[0];
+    char next = rest.size() > 1 ? rest[1] : '\0';
+
+    if (op == ':' && (next == '-' || next == '+' || next == '=')) {
+        CommandPart word = rest.subPart(2);
+        if (next == '+') return value.empty() ? "" : context.expandWord(word);
+        if (!value.empty()) return value;
+        std::string defaultValue = context.expandWord(word);
+        if (next == '=') context.assign(name, defaultValue);
+        return defaultValue;
+    }
+    if (op == '-') {
+        CommandPart word = rest.subPart(1);
+        return variable ? value : context.expandWord(word);
+    }
+    if (op == ':') {
+        // offset and length are arithmetic expressions
+        size_t colon = rest.string.find(':', 1);
+        std::string offsetExpression = rest.string.substr(1, colon == std::string::npos ? colon : colon - 1);
+        int64_t offset = context.evaluate(offsetExpression);
+        if (offset < 0) offset += (int64_t) value.length();
+        if (offset < 0 || offset > (int64_t) value.length()) return "";
+
+        int64_t size = (int64_t) value.length() - offset;
+        if (colon != std::string::npos) {
+            int64_t requested = context.evaluate(rest.string.substr(colon + 1));
+            if (requested < 0) requested += size;
+            if (requested < 0) throw std::invalid_argument("Substring length is negative: ${" + expression.string + "}");
+            if (requested < size) size = requested;
+        }
+        return value.substr((size_t) offset, (size_t) size);
+    }
+    if (op == '#' || op == '%') {
+        bool longest = next == op;
+        CommandPart pattern = rest.subPart(longest ? 2 : 1);
+        return removeMatch(value, pattern, op == '#', longest);
+    }
+    if (op == '/') {
+        bool all = next == '/';
+        CommandPart patternAndReplacement = rest.subPart(all ? 2 : 1);
+        size_t slash = patternAndReplacement.findEntering('/');
+        CommandPart pattern = patternAndReplacement.subPart(0, slash);
+        CommandPart replacementWord = slash == std::string::npos ? CommandPart{} : patternAndReplacement.subPart(slash + 1);
+        std::string replacement = replacementWord.empty() ? "" : context.expandWord(replacementWord);
+        return replaceMatches(value, pattern, replacement, all);
+    }
+    throw std::invalid_argument("Bad substitution: ${" + expression.string + "}");
+}
@@ -0,0 +1,56 @@
+#include "recordReader.h"
+
+#include <stdexcept>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+bool RecordReader::read(int file, char delimiter, size_t count, std::string& record) {
+    struct stat fileStat;
+    if (fstat(file, &fileStat) < 0) throw std::runtime_error("Cannot read from given file!");
+
+    // the descriptor may have been reused for another file
+    auto found = buffers.find(file);
+    if (found != buffers.end() && (found->second.device != fileStat.st_dev || found->second.inode != fileStat.st_ino)) {
+        buffers.erase(found);
+    }
+    Buffer& buffer = buffers[file];
+    buffer.device = fileStat.st_dev;
+    buffer.inode = fileStat.st_ino;
+    IOBuffer& data = buffer.data;
+
+    bool seekable = lseek(file, 0, SEEK_CUR) != -1;
+    bool endOfFile = false;
+    bool result = true;
+
+    while (true) {
+        size_t delimiterPosition = data.find(delimiter, count);
+        if (delimiterPosition != std::string::npos) {
+            record = data.str(delimiterPosition);
+            data.consume(delimiterPosition + 1);
+            break;
+        }
+        if (data.size() >= count) {
+            record = data.str(count);
+            data.consume(count);
+            break;
+        }
+        if (endOfFile) {
+            result = !data.empty();
+            record = data.str();
+            data.clear();
+            break;
+        }
+        endOfFile = data.readSome(file) == 0;
+    }
+
+    if (seekable) {
+        if (!data.empty()) lseek(file, -(off_t) data.size(), SEEK_CUR);
+        buffers.erase(file);
+    }
+    return result;
+}
+
+void RecordReader::forget(int file) {
+    buffers.erase(file);
+}
@@ -17,6 +17,16 @@ bool isRedirect(CommandPart command) {
     return true;
 }
 
+bool isDescriptorRedirect(CommandPart command) {
+    size_t i = 0;
+    while (i < command.size() && std::string("0123456789").find(command[i]) != std::string::npos) ++i;
+
+    if (i < command.size() && (command[i] == '<' || command[i] == '>') && !command.escaped[i]) ++i;
+    else return false;
+
+    return i == command.size() - 1 && command[i] == '&' && !command.escaped[i];
+}
+
 std::tuple<int, int, int> parseRedirect(CommandPart command, int defaultOut, int defaultIn) {
     int from = -1, direction = 0, to = -1;
 
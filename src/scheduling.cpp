@@ -0,0 +1,148 @@
+#include "scheduling.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Not exposed by glibc, see ioprio_set(2)
+static const int IOPRIO_CLASS_SHIFT = 13;
+static const int IOPRIO_WHO_PROCESS = 1;
+
+static unsigned long long parseNumber(const std::string& value, const std::string& option, bool sizeSuffix=false) {
+    size_t end = 0;
+    unsigned long long result;
+    try {
+        result = std::stoull(value, &end);
+    } catch (...) {
+        throw std::invalid_argument("Invalid value for " + option + ": " + value);
+    }
+
+    if (sizeSuffix && end + 1 == value.length()) {
+        switch (value[end]) {
+            case 'K': case 'k': result <<= 10; break;
+            case 'M': case 'm': result <<= 20; break;
+            case 'G': case 'g': result <<= 30; break;
+            case 'T': case 't': result <<= 40; break;
+            default: throw std::invalid_argument("Invalid value for " + option + ": " + value);
+        }
+        ++end;
+    }
+    if (end != value.length()) throw std::invalid_argument("Invalid value for " + option + ": " + value);
+    return result;
+}
+
+// Parses cpu lists in the format used by taskset and sysfs: 0-3,8,10-11
+static void parseCpuList(const std::string& list, cpu_set_t& cpus, const std::string& option) {
+    size_t start = 0;
+    while (start < list.length()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.length();
+        std::string range = list.substr(start, end - start);
+
+        size_t dash = range.find('-');
+        unsigned long long first = parseNumber(range.substr(0, dash), option);
+        unsigned long long last = dash == std::string::npos ? first : parseNumber(range.substr(dash + 1), option);
+        if (last < first || last >= CPU_SETSIZE) throw std::invalid_argument("Invalid cpu range for " + option + ": " + range);
+        for (unsigned long long cpu = first; cpu <= last; ++cpu) CPU_SET(cpu, &cpus);
+
+        start = end + 1;
+    }
+}
+
+static int parseLimitName(const std::string& name) {
+    if (name == "as") return RLIMIT_AS;
+    if (name == "core") return RLIMIT_CORE;
+    if (name == "cpu") return RLIMIT_CPU;
+    if (name == "data") return RLIMIT_DATA;
+    if (name == "fsize") return RLIMIT_FSIZE;
+    if (name == "memlock") return RLIMIT_MEMLOCK;
+    if (name == "nofile") return RLIMIT_NOFILE;
+    if (name == "nproc") return RLIMIT_NPROC;
+    if (name == "stack") return RLIMIT_STACK;
+    throw std::invalid_argument("Unknown resource limit: " + name);
+}
+
+bool Scheduling::empty() const {
+    return !setAffinity && !setNice && ioClass == -1 && limits.empty();
+}
+
+size_t Scheduling::parse(std::vector<CommandPart>& parts, size_t start) {
+    size_t i = start;
+    for (; i < parts.size(); ++i) {
+        std::string& part = parts[i].string;
+        if (part == "--") return i + 1;
+        if (part.substr(0, 2) != "--") break;
+
+        // the expansion splits "--option=value" into "--option", "=", "value"
+        std::string option = part;
+        if (i + 2 >= parts.size() || !(parts[i + 1] == "=") || parts[i + 1].escaped[0])
+            throw std::invalid_argument("Expected a value for " + option);
+        std::string value = parts[i + 2].string;
+        i += 2;
+
+        if (option == "--cpus") {
+            if (!setAffinity) CPU_ZERO(&cpus);
+            setAffinity = true;
+            parseCpuList(value, cpus, option);
+        } else if (option == "--nodes") {
+            if (!setAffinity) CPU_ZERO(&cpus);
+            setAffinity = true;
+            size_t nodeStart = 0;
+            while (nodeStart < value.length()) {
+                size_t nodeEnd = value.find(',', nodeStart);
+                if (nodeEnd == std::string::npos) nodeEnd = value.length();
+                std::string node = std::to_string(parseNumber(value.substr(nodeStart, nodeEnd - nodeStart), option));
+
+                std::ifstream cpuList("/sys/devices/system/node/node" + node + "/cpulist");
+                std::string list;
+                if (!std::getline(cpuList, list)) throw std::invalid_argument("Unknown NUMA node: " + node);
+                parseCpuList(list, cpus, option);
+
+                nodeStart = nodeEnd + 1;
+            }
+        } else if (option == "--nice") {
+            setNice = true;
+            try {
+                nice = std::stoi(value);
+            } catch (...) {
+                throw std::invalid_argument("Invalid value for --nice: " + value);
+            }
+        } else if (option == "--ioclass") {
+            if (value == "realtime" || value == "1") ioClass = 1;
+            else if (value == "best-effort" || value == "2") ioClass = 2;
+            else if (value == "idle" || value == "3") ioClass = 3;
+            else throw std::invalid_argument("Invalid value for --ioclass: " + value);
+        } else if (option == "--ioprio") {
+            ioLevel = (int) parseNumber(value, option);
+            if (ioLevel > 7) throw std::invalid_argument("Invalid value for --ioprio: " + value);
+            if (ioClass == -1) ioClass = 2;
+        } else if (option.substr(0, 9) == "--rlimit-") {
+            rlim_t limit = value == "unlimited" ? RLIM_INFINITY : (rlim_t) parseNumber(value, option, true);
+            limits.emplace_back(parseLimitName(option.substr(9)), limit);
+        } else {
+            throw std::invalid_argument("Unknown option: " + option);
+        }
+    }
+    return i;
+}
+
+void Scheduling::apply() const {
+    if (setAffinity && sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+        throw std::runtime_error("Could not set cpu affinity");
+    if (setNice && setpriority(PRIO_PROCESS, 0, nice) < 0)
+        throw std::runtime_error("Could not set nice value");
+    if (ioClass != -1) {
+        int ioprio = (ioClass << IOPRIO_CLASS_SHIFT) | (ioClass == 3 ? 0 : ioLevel);
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) < 0)
+            throw std::runtime_error("Could not set io priority");
+    }
+    for (auto& limit: limits) {
+        struct rlimit rlimit;
+        if (getrlimit(limit.first, &rlimit) < 0)
+            throw std::runtime_error("Could not get resource limit");
+        rlimit.rlim_cur = limit.second;
+        if (setrlimit(limit.first, &rlimit) < 0)
+            throw std::runtime_error("Could not set resource limit");
+    }
+}
@@ -0,0 +1,31 @@
+#include "startupProfile.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+void StartupProfile::add(const std::string& name, double microseconds) {
+    phases.emplace_back(name, microseconds);
+}
+
+void StartupProfile::report() {
+    if (!enabled || reported) return;
+    reported = true;
+
+    double total = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    double measured = 0;
+
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1);
+    stream << "startup profile (us):\n";
+    for (auto& phase: phases) {
+        stream << "  " << std::setw(24) << std::left << phase.first
+               << std::setw(10) << std::right << phase.second << "\n";
+        measured += phase.second;
+    }
+    stream << "  " << std::setw(24) << std::left << "other"
+           << std::setw(10) << std::right << (total - measured) << "\n";
+    stream << "  " << std::setw(24) << std::left << "total"
+           << std::setw(10) << std::right << total << "\n";
+    std::cerr << stream.str();
+}
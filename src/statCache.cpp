@@ -0,0 +1,23 @@
+#include "statCache.h"
+
+#include <errno.h>
+
+void StatCache::setDirectory(int newDirectory) {
+    if (newDirectory == directory) return;
+    directory = newDirectory;
+    clear();
+}
+
+const struct stat* StatCache::get(const std::string& path) {
+    auto found = entries.find(path);
+    if (found == entries.end()) {
+        if (entries.size() >= MAX_ENTRIES) entries.clear();
+
+        Entry entry;
+        int result;
+        while ((result = fstatat(directory, path.c_str(), &entry.fileStat, 0)) < 0 && errno == EINTR);
+        entry.exists = result == 0;
+        found = entries.emplace(path, entry).first;
+    }
+    return found->second.exists ? &found->second.fileStat : nullptr;
+}
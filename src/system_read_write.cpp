@@ -1,43 +1,21 @@
 #include "system_read_write.h"
 
 #include <stdexcept>
-#include <sstream>
 
-std::string readAll(int filed) {
-    std::ostringstream result{};
-
-    static int size = 1024 * 128;
-    char* buffer = new char[size + 1];
-    int number_read = 0;
-
-    while (true) {
-        errno = 0;
-        int current_number_read = read(filed, buffer + number_read, (size - number_read));
-        if (current_number_read < 0) {
-            if (errno == EINTR) continue;
-            throw std::runtime_error("Cannot read from given file!");
-        }
-        if (current_number_read == 0) {
-            buffer[number_read] = '\0';
-            result << buffer;
-            break;
-        }
-        number_read += current_number_read;
-        if (number_read == size) {
-            buffer[size] = '\0';
-            result << buffer;
-        }
-    }
+#include "ioBuffer.h"
 
-    return result.str();
+std::string readAll(int filed) {
+    IOBuffer buffer;
+    buffer.readAll(filed);
+    return buffer.str();
 }
 
-void writeAll(int filed, std::string message) {
-    int number_written = 0;
+void writeAll(int filed, const std::string& message) {
+    size_t number_written = 0;
 
-    while(number_written < message.length()) {
+    while (number_written < message.length()) {
         errno = 0;
-        int current_number_written = write(filed, &(message.c_str()[number_written]), message.length() - number_written);
+        ssize_t current_number_written = write(filed, message.c_str() + number_written, message.length() - number_written);
         if (current_number_written < 0) {
             if (errno != EINTR) throw std::runtime_error("Cannot write to given file!");
         } else {
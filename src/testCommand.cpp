@@ -0,0 +1,155 @@
+#include "testCommand.h"
+
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+class TestParser {
+    const std::vector<std::string>& arguments;
+    StatCache& statCache;
+    size_t position = 0;
+
+public:
+    TestParser(const std::vector<std::string>& arguments, StatCache& statCache):
+        arguments(arguments), statCache(statCache) {}
+
+    bool parse() {
+        if (arguments.empty()) return false;
+        bool result = parseOr();
+        if (position != arguments.size()) throw std::invalid_argument("mtest: unexpected argument " + arguments[position]);
+        return result;
+    }
+
+private:
+    bool has(size_t offset = 0) const { return position + offset < arguments.size(); }
+    const std::string& peek(size_t offset = 0) const { return arguments[position + offset]; }
+
+    const std::string& next() {
+        if (!has()) throw std::invalid_argument("mtest: argument expected");
+        return arguments[position++];
+    }
+
+    bool parseOr() {
+        bool result = parseAnd();
+        while (has() && peek() == "-o") {
+            ++position;
+            result = parseAnd() || result;
+        }
+        return result;
+    }
+
+    bool parseAnd() {
+        bool result = parseNot();
+        while (has() && peek() == "-a") {
+            ++position;
+            result = parseNot() && result;
+        }
+        return result;
+    }
+
+    bool parseNot() {
+        // "!" alone is a non-empty string
+        if (has(1) && peek() == "!") {
+            ++position;
+            return !parseNot();
+        }
+        return parsePrimary();
+    }
+
+    static bool isBinary(const std::string& op) {
+        return op == "=" || op == "==" || op == "!=" || op == "-eq" || op == "-ne" || op == "-lt" ||
+               op == "-le" || op == "-gt" || op == "-ge" || op == "-nt" || op == "-ot";
+    }
+
+    static bool isUnary(const std::string& op) {
+        return op.length() == 2 && op[0] == '-' && std::string("efdxrwsLhzn").find(op[1]) != std::string::npos;
+    }
+
+    static long long toInteger(const std::string& value) {
+        size_t end = 0;
+        long long result;
+        try {
+            result = std::stoll(value, &end);
+        } catch (...) {
+            end = 0;
+        }
+        if (value.empty() || end != value.length()) throw std::invalid_argument("mtest: integer expected: " + value);
+        return result;
+    }
+
+    bool parsePrimary() {
+        if (has(2) && isBinary(peek(1))) {
+            const std::string& left = next();
+            const std::string& op = next();
+            const std::string& right = next();
+            return binary(left, op, right);
+        }
+        if (has(1) && isUnary(peek())) {
+            const std::string& op = next();
+            return unary(op[1], next());
+        }
+        return !next().empty();
+    }
+
+    bool unary(char op, const std::string& argument) {
+        if (op == 'z') return argument.empty();
+        if (op == 'n') return !argument.empty();
+        if (op == 'L' || op == 'h') {
+            struct stat fileStat;
+            return fstatat(statCache.getDirectory(), argument.c_str(), &fileStat, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(fileStat.st_mode);
+        }
+
+        const struct stat* fileStat = statCache.get(argument);
+        if (!fileStat) return false;
+        switch (op) {
+            case 'e': return true;
+            case 'f': return S_ISREG(fileStat->st_mode);
+            case 'd': return S_ISDIR(fileStat->st_mode);
+            case 's': return fileStat->st_size > 0;
+            case 'x': return faccessat(statCache.getDirectory(), argument.c_str(), X_OK, 0) == 0;
+            case 'r': return faccessat(statCache.getDirectory(), argument.c_str(), R_OK, 0) == 0;
+            default: return faccessat(statCache.getDirectory(), argument.c_str(), W_OK, 0) == 0;
+        }
+    }
+
+    static bool newer(const struct stat& left, const struct stat& right) {
+        if (left.st_mtim.tv_sec != right.st_mtim.tv_sec) return left.st_mtim.tv_sec > right.st_mtim.tv_sec;
+        return left.st_mtim.tv_nsec > right.st_mtim.tv_nsec;
+    }
+
+    bool binary(const std::string& left, const std::string& op, const std::string& right) {
+        if (op == "=" || op == "==") return left == right;
+        if (op == "!=") return left != right;
+        if (op == "-nt") {
+            // like bash, an existing file is newer than a missing one
+            const struct stat* leftStat = statCache.get(left);
+            const struct stat* rightStat = statCache.get(right);
+            if (!leftStat) return false;
+            if (!rightStat) return true;
+            return newer(*leftStat, *rightStat);
+        }
+        if (op == "-ot") {
+            // a missing file is older than an existing one, an existing one is not older than a missing one
+            const struct stat* leftStat = statCache.get(left);
+            const struct stat* rightStat = statCache.get(right);
+            if (!rightStat) return false;
+            if (!leftStat) return true;
+            return newer(*rightStat, *leftStat);
+        }
+
+        long long leftValue = toInteger(left), rightValue = toInteger(right);
+        if (op == "-eq") return leftValue == rightValue;
+        if (op == "-ne") return leftValue != rightValue;
+        if (op == "-lt") return leftValue < rightValue;
+        if (op == "-le") return leftValue <= rightValue;
+        if (op == "-gt") return leftValue > rightValue;
+        return leftValue >= rightValue;
+    }
+};
+
+}
+
+bool evaluateTest(const std::vector<std::string>& arguments, StatCache& statCache) {
+    return TestParser{arguments, statCache}.parse();
+}
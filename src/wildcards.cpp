@@ -4,10 +4,11 @@
 #include <stdexcept>
 #include <boost/filesystem.hpp>
 
-bool testWildCard(std::string str, CommandPart& wildCard, size_t strI, size_t wildCardI) {
-    for (;strI < str.size() && wildCardI < wildCard.size(); ++strI, ++wildCardI) {
+// Matches str[strI, strEnd) against the rest of the wild card
+static bool testWildCard(const std::string& str, size_t strEnd, CommandPart& wildCard, size_t strI, size_t wildCardI) {
+    for (;strI < strEnd && wildCardI < wildCard.size(); ++strI, ++wildCardI) {
         if (wildCard.escaped[wildCardI]) {
-            if (str[strI] != wildCard[++wildCardI]) return false;
+            if (str[strI] != wildCard[wildCardI]) return false;
         } else if (wildCard[wildCardI] == '[') {
             bool passed = false;
             ++wildCardI;
@@ -22,12 +23,13 @@ bool testWildCard(std::string str, CommandPart& wildCard, size_t strI, size_t wi
                     break;
                 }
             }
+            // skip to the closing bracket
+            while (wildCardI < wildCard.size() - 1 && (wildCard.escaped[wildCardI] || wildCard[wildCardI] != ']')) ++wildCardI;
 
-            ++wildCardI; // skip ]
             if (!passed) return false;
         } else if (wildCard[wildCardI] == '*') {
-            for (;strI <= str.size(); ++strI) {
-                if (testWildCard(str, wildCard, strI, wildCardI + 1)) return true;
+            for (;strI <= strEnd; ++strI) {
+                if (testWildCard(str, strEnd, wildCard, strI, wildCardI + 1)) return true;
             }
 
             return false;
@@ -36,38 +38,56 @@ bool testWildCard(std::string str, CommandPart& wildCard, size_t strI, size_t wi
         }
     }
 
-    return strI == str.size() && wildCardI == wildCard.size();
+    // trailing stars match an empty string
+    while (wildCardI < wildCard.size() && wildCard[wildCardI] == '*' && !wildCard.escaped[wildCardI]) ++wildCardI;
+    return strI == strEnd && wildCardI == wildCard.size();
 }
 
 bool testWildCard(std::string str, CommandPart wildCard) {
-    return testWildCard(str, wildCard, 0, 0);
+    return testWildCard(str, str.size(), wildCard, 0, 0);
+}
+
+bool testWildCard(const std::string& str, size_t start, size_t end, CommandPart& wildCard) {
+    return testWildCard(str, end, wildCard, start, 0);
 }
 
 bool isWildCard(CommandPart& part) {
     for (size_t i = 0; i < part.size(); ++i) {
         if (part.escaped[i]) continue;
-        if (part[i] == '[' || part[i] == '*' || part[i] == '?') return true;
+        if (part[i] == '*' || part[i] == '?') return true;
+        // "[" is only a wild card with the closing bracket
+        if (part[i] == '[' && part.string.find(']', i + 1) != std::string::npos) return true;
     }
     return false;
 }
 
-std::vector<std::string> expandWildCard (CommandPart partToParse) {
+size_t forEachWildCardMatch(CommandPart partToParse, const std::function<void(const std::string&)>& onMatch,
+                            size_t* scannedEntries) {
     size_t filenameSlash = partToParse.string.find_last_of('/');
     std::string directory = filenameSlash == std::string::npos ? "." : partToParse.string.substr(0, filenameSlash);
     CommandPart wildCard = filenameSlash == std::string::npos ? partToParse : partToParse.subPart(filenameSlash + 1);
 
 //    if (isWildCard(directory))
 //        throw std::runtime_error("Wild card is not supported for directories (" + directory + ")");
-    std::vector<std::string> passedFiles;
+    size_t matches = 0;
 
     boost::filesystem::directory_iterator endIterator;
     for(boost::filesystem::directory_iterator iterator(directory); iterator != endIterator; ++iterator) {
+        if (scannedEntries) ++*scannedEntries;
         if (!boost::filesystem::is_regular_file(iterator->status())) continue;
 
         boost::filesystem::path file = *iterator;
-        if (testWildCard(file.filename().string(), wildCard))
-            passedFiles.push_back(file.lexically_normal().string());
+        if (testWildCard(file.filename().string(), wildCard)) {
+            onMatch(file.lexically_normal().string());
+            ++matches;
+        }
     }
+    return matches;
+}
+
+std::vector<std::string> expandWildCard (CommandPart partToParse, size_t* scannedEntries) {
+    std::vector<std::string> passedFiles;
+    forEachWildCardMatch(partToParse, [&](const std::string& file) { passedFiles.push_back(file); }, scannedEntries);
 
     if (passedFiles.empty()) {
         throw std::runtime_error("Wild card " + partToParse.string + " could not be extended.");
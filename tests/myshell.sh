@@ -0,0 +1,68 @@
+#!/bin/sh
+# Runs myshell on single-line scripts and compares their output.
+# Usage: tests/myshell.sh <path to myshell>
+
+MYSHELL=${1:-./myshell}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+failed=0
+
+# check <lines> <expected output>
+check() {
+    printf '%s\n' "$1" > "$DIR/script"
+    actual=$(cd "$DIR" && "$MYSHELL" script 2>&1)
+    if [ "$actual" != "$2" ]; then
+        printf 'FAIL: %s\n  expected: %s\n  actual:   %s\n' "$1" "$2" "$actual"
+        failed=1
+    fi
+}
+
+# parentheses only form a group at the start of a word
+check 'mecho a(b)c' 'a(b)c'
+check 'mecho 1 |> (cat) (cat)' '1
+1'
+
+# a pipeline inside a fan-out group reads the relay, redirects after the groups apply to the consumers
+check 'mecho hello |> (head -c 3 | wc -c)' '3'
+check 'mecho hello |> (wc -c) > out
+cat out' '6'
+
+# ${...} is joined with the text next to it and expanded inside double quotes
+check 'f = app.log
+mecho ${f%.log}.bak pre${f}post' 'app.bak preapp.logpost'
+check 'f = app.log
+mecho "${f}" "x${f}y"' 'app.log xapp.logy'
+check 'x = "1 2"
+mecho ${x} ${nothing:-a b}c' '1 2 a bc'
+check 'mecho ${x' 'Bad substitution'
+check 'mecho a${x' 'Bad substitution'
+check 'mecho "a${x"' 'Bad substitution'
+
+# $((...)) is joined with the text next to it and expanded inside double quotes
+check 'i = 2
+mecho "$((i*3))" x' '6 x'
+check 'i = 2
+mecho "v $((i*3))" a$((1+1))b $((1 + (2*3)))' 'v 6 a2b 7'
+
+# -nt and -ot with a missing operand behave like in bash
+check 'mecho > old
+mtest old -ot missing
+merrno
+mtest missing -ot old
+merrno
+mtest old -nt missing
+merrno
+mtest missing -nt old
+merrno' '1
+0
+0
+1'
+
+# mbatch only expands the unquoted wild cards
+check 'mecho > a.log
+mbatch mecho "*.log" *.log' '*.log ./a.log'
+
+# a first word that expands to nothing
+check '$nothing mecho hi' 'hi'
+
+exit $failed